@@ -0,0 +1,233 @@
+/*
+  ==============================================================================
+
+    BlockTimings.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+//==============================================================================
+/** What one processBlock call cost, and which of the slower paths it took */
+struct BlockTiming
+{
+    enum SlowPath : juce::uint16
+    {
+        segmentSplit   = 1 << 0,   // queued automation split the block into several runs
+        ringWrap       = 1 << 1,   // the block's writes straddle the end of the delay memory, so each tap reads two spans
+        silentSkip     = 1 << 2,   // skipped as silent
+        tapPatternSwap = 1 << 3,   // picked up a new multi-tap pattern
+        denseTapsSwap  = 1 << 4    // picked up a new dense taps engine
+    };
+
+    static constexpr int numSlowPaths = 5;
+
+    static const char* getSlowPathName (int index) noexcept
+    {
+        static const char* const names[] = { "segment split", "ring wrap", "silent skip", "tap pattern swap", "dense taps swap" };
+        return juce::isPositiveAndBelow (index, numSlowPaths) ? names[index] : "";
+    }
+
+    float seconds = 0;              // wall time spent in processBlock
+    float load = 0;                 // seconds over the block's duration, so 1 is the whole realtime budget
+    juce::uint32 numSamples = 0;
+    juce::uint16 numSegments = 0;
+    juce::uint16 slowPaths = 0;     // SlowPath bits
+};
+
+//==============================================================================
+/**
+    The last capacity BlockTimings, written by the audio thread and read by
+    any number of other threads (the editor, a test harness), none of which
+    ever waits for another.
+
+    Unlike a FIFO, the writer never runs out of room: it overwrites the
+    oldest timings, so monitoring costs the same whether anybody reads or
+    not. Each reader keeps its own cursor, and finds out how many timings it
+    missed if it fell more than capacity behind.
+
+    A slot is two atomic words and works like a seqlock: the writer bumps
+    begun before it overwrites a slot and published after, and a reader
+    throws away a slot it copied if begun shows it was overwritten meanwhile.
+*/
+class BlockTimingRing
+{
+public:
+    static constexpr int capacity = 4096;   // about 40 s of 512-sample blocks at 48 kHz
+
+    BlockTimingRing() = default;
+
+    //==============================================================================
+    /** Writer side, the audio thread only */
+    void push (const BlockTiming& timing) noexcept
+    {
+        const auto index = published.load (std::memory_order_relaxed);
+
+        begun.store (index + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence (std::memory_order_release);
+
+        auto& slot = slots[(size_t) (index & mask)];
+        slot[0].store (packWord (timing.seconds, timing.numSamples), std::memory_order_relaxed);
+        slot[1].store (packWord (timing.load, (juce::uint32) timing.numSegments | ((juce::uint32) timing.slowPaths << 16)),
+                       std::memory_order_relaxed);
+
+        published.store (index + 1, std::memory_order_release);
+    }
+
+    //==============================================================================
+    /** The number of timings pushed so far; start a cursor here to read only new ones */
+    juce::int64 getNumPushed() const noexcept
+    {
+        return published.load (std::memory_order_acquire);
+    }
+
+    /**
+        Reader side: calls callback (const BlockTiming&) for every timing from
+        cursor on that is still in the ring, oldest first, and moves cursor
+        past them. Returns how many were lost to the writer lapping the reader.
+    */
+    template <typename Callback>
+    juce::int64 read (juce::int64& cursor, Callback&& callback) const
+    {
+        const auto end = published.load (std::memory_order_acquire);
+        juce::int64 numLost = 0;
+
+        if (end - cursor > capacity)
+        {
+            numLost = end - capacity - cursor;
+            cursor = end - capacity;
+        }
+
+        for (; cursor < end; ++cursor)
+        {
+            auto& slot = slots[(size_t) (cursor & mask)];
+            const auto word0 = slot[0].load (std::memory_order_relaxed);
+            const auto word1 = slot[1].load (std::memory_order_relaxed);
+
+            std::atomic_thread_fence (std::memory_order_acquire);
+
+            if (begun.load (std::memory_order_relaxed) - cursor > capacity)
+            {
+                ++numLost;
+                continue;
+            }
+
+            BlockTiming timing;
+            timing.seconds     = unpackFloat (word0);
+            timing.numSamples  = (juce::uint32) word0;
+            timing.load        = unpackFloat (word1);
+            timing.numSegments = (juce::uint16) word1;
+            timing.slowPaths   = (juce::uint16) (word1 >> 16);
+            callback (timing);
+        }
+
+        return numLost;
+    }
+
+private:
+    static constexpr juce::int64 mask = capacity - 1;
+    static_assert (juce::isPowerOfTwo (capacity), "the ring wraps with a mask");
+
+    std::array<std::array<std::atomic<juce::uint64>, 2>, (size_t) capacity> slots {};
+    std::atomic<juce::int64> begun { 0 }, published { 0 };
+
+    /* a float's bits in the top half, 32 more bits in the bottom one */
+    static juce::uint64 packWord (float value, juce::uint32 low) noexcept
+    {
+        juce::uint32 bits;
+        std::memcpy (&bits, &value, sizeof (bits));
+        return ((juce::uint64) bits << 32) | low;
+    }
+
+    static float unpackFloat (juce::uint64 word) noexcept
+    {
+        const auto bits = (juce::uint32) (word >> 32);
+        float value;
+        std::memcpy (&value, &bits, sizeof (value));
+        return value;
+    }
+
+    JUCE_DECLARE_NON_COPYABLE (BlockTimingRing)
+};
+
+//==============================================================================
+/**
+    A histogram of block loads, with the percentiles read off it, and how
+    often each slow path was taken. Fill it from a BlockTimingRing on the
+    reading thread; the audio thread never touches it.
+*/
+class BlockLoadStatistics
+{
+public:
+    static constexpr int numBins = 400;         // 0.5 % of the budget wide, up to 200 %
+    static constexpr float binWidth = 0.005f;
+
+    void add (const BlockTiming& timing) noexcept
+    {
+        const auto bin = juce::jlimit (0, numBins, (int) (timing.load / binWidth));
+        ++histogram[(size_t) bin];
+
+        ++numBlocks;
+        loadSum += timing.load;
+        maxLoad = juce::jmax (maxLoad, timing.load);
+        numSegments += timing.numSegments;
+
+        for (int i = 0; i < BlockTiming::numSlowPaths; ++i)
+            if ((timing.slowPaths & (1 << i)) != 0)
+                ++slowPathCounts[(size_t) i];
+    }
+
+    void reset() noexcept
+    {
+        *this = {};
+    }
+
+    //==============================================================================
+    juce::int64 getNumBlocks() const noexcept           { return numBlocks; }
+    juce::int64 getNumSegments() const noexcept         { return numSegments; }
+    float getMaxLoad() const noexcept                   { return maxLoad; }
+
+    float getMeanLoad() const noexcept
+    {
+        return numBlocks > 0 ? (float) (loadSum / (double) numBlocks) : 0.0f;
+    }
+
+    /** The load that a fraction of the blocks (0.99 for p99) stayed at or under, rounded up to a bin */
+    float getLoadPercentile (double fraction) const noexcept
+    {
+        if (numBlocks == 0)
+            return 0.0f;
+
+        const auto rank = (juce::int64) std::ceil (fraction * (double) numBlocks);
+        juce::int64 count = 0;
+
+        for (int bin = 0; bin < numBins; ++bin)
+        {
+            count += histogram[(size_t) bin];
+
+            if (count >= rank)
+                return juce::jmin ((float) (bin + 1) * binWidth, maxLoad);
+        }
+
+        return maxLoad;
+    }
+
+    /** Blocks per bin of binWidth; the last one holds everything from 200 % up */
+    const std::array<juce::int64, numBins + 1>& getHistogram() const noexcept
+    {
+        return histogram;
+    }
+
+    juce::int64 getSlowPathCount (int index) const noexcept
+    {
+        return juce::isPositiveAndBelow (index, BlockTiming::numSlowPaths) ? slowPathCounts[(size_t) index] : 0;
+    }
+
+private:
+    std::array<juce::int64, numBins + 1> histogram {};
+    std::array<juce::int64, BlockTiming::numSlowPaths> slowPathCounts {};
+    juce::int64 numBlocks = 0, numSegments = 0;
+    double loadSum = 0;
+    float maxLoad = 0;
+};
@@ -0,0 +1,138 @@
+/*
+  ==============================================================================
+
+    Damping.h
+
+    Filters for the feedback path of Delay, so each repeat comes back darker
+    (lowpass) or thinner (highpass) than the one before. Delay runs them in
+    the same per-sample loop as the feedback gain and the saturator, so they
+    cost no extra pass over the buffer.
+
+    The coefficients are computed once per setDamping() or prepare(), never
+    while processing. All sections are transposed direct form II, with the
+    one-pole ones simply leaving out the second state.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+namespace Damping
+{
+    enum class Mode
+    {
+        off,
+        onePoleLowpass,     //  6 dB/octave
+        onePoleHighpass,
+        lowpass,            // 12 dB/octave biquads, RBJ cookbook
+        highpass
+    };
+
+    /** Normalised so a0 is 1 */
+    template <typename Type>
+    struct Coefficients
+    {
+        Type b0 { Type (1) }, b1 { Type (0) }, b2 { Type (0) };
+        Type a1 { Type (0) }, a2 { Type (0) };
+        int order = 0;
+
+        static Coefficients make (Mode mode, double cutoffHz, double q, double sampleRate)
+        {
+            jassert (sampleRate > 0 && q > 0);
+
+            const auto w = juce::MathConstants<double>::twoPi * juce::jlimit (1.0, 0.49 * sampleRate, cutoffHz) / sampleRate;
+            Coefficients c;
+
+            switch (mode)
+            {
+                case Mode::onePoleLowpass:
+                case Mode::onePoleHighpass:
+                {
+                    const auto pole = std::exp (-w);
+                    const auto gain = mode == Mode::onePoleLowpass ? 1.0 - pole : 0.5 * (1.0 + pole);
+
+                    c.b0 = (Type) gain;
+                    c.b1 = (Type) (mode == Mode::onePoleLowpass ? 0.0 : -gain);
+                    c.a1 = (Type) -pole;
+                    c.order = 1;
+                    break;
+                }
+
+                case Mode::lowpass:
+                case Mode::highpass:
+                {
+                    const auto cosW = std::cos (w);
+                    const auto alpha = std::sin (w) / (2.0 * q);
+                    const auto a0 = 1.0 + alpha;
+                    const auto side = mode == Mode::lowpass ? (1.0 - cosW) / 2.0 : (1.0 + cosW) / 2.0;
+
+                    c.b0 = (Type) (side / a0);
+                    c.b1 = (Type) ((mode == Mode::lowpass ? 2.0 : -2.0) * side / a0);
+                    c.b2 = (Type) (side / a0);
+                    c.a1 = (Type) (-2.0 * cosW / a0);
+                    c.a2 = (Type) ((1.0 - alpha) / a0);
+                    c.order = 2;
+                    break;
+                }
+
+                case Mode::off:
+                default:
+                    break;
+            }
+
+            return c;
+        }
+    };
+
+    template <typename Type>
+    struct State
+    {
+        Type s1 { Type (0) }, s2 { Type (0) };
+    };
+
+    //==============================================================================
+    /**
+        One channel's filter for one run of samples: a copy of the coefficients
+        and the channel's state, with the order fixed at compile time so the
+        loop it is inlined into carries no branch and, when off, no work.
+    */
+    template <typename Type, int order>
+    struct Section
+    {
+        Coefficients<Type> c;
+        State<Type>& state;
+
+        Type process (Type x) noexcept
+        {
+            if constexpr (order == 0)
+            {
+                return x;
+            }
+            else if constexpr (order == 1)
+            {
+                auto y = c.b0 * x + state.s1;
+                state.s1 = c.b1 * x - c.a1 * y;
+                return y;
+            }
+            else
+            {
+                auto y = c.b0 * x + state.s1;
+                state.s1 = c.b1 * x - c.a1 * y + state.s2;
+                state.s2 = c.b2 * x - c.a2 * y;
+                return y;
+            }
+        }
+    };
+
+    /** Calls function with the Section that matches the order of the coefficients */
+    template <typename Type, typename Function>
+    void withSection (const Coefficients<Type>& c, State<Type>& state, Function&& function)
+    {
+        switch (c.order)
+        {
+            case 1:  function (Section<Type, 1> { c, state }); break;
+            case 2:  function (Section<Type, 2> { c, state }); break;
+            default: function (Section<Type, 0> { c, state }); break;
+        }
+    }
+}
@@ -10,82 +10,189 @@
 
 #pragma once
 
+#include "Saturation.h"
+#include "OversampledSaturator.h"
+#include "Damping.h"
+#include "Interpolation.h"
+
+/**
+    At most two contiguous runs of samples that together cover a range of a
+    ring buffer. The second run is empty unless the range wraps around the end
+    of the storage.
+*/
+template <typename Type>
+struct DelaySpans
+{
+    Type* first = nullptr;
+    size_t firstSize = 0;
+    Type* second = nullptr;
+    size_t secondSize = 0;
+    
+    size_t size() const noexcept
+    {
+        return firstSize + secondSize;
+    }
+    
+    /** Returns the sample at index within the range and how many samples follow it contiguously */
+    Type* at (size_t index, size_t& contiguous) const noexcept
+    {
+        jassert (index < size());
+        
+        if (index < firstSize)
+        {
+            contiguous = firstSize - index;
+            return first + index;
+        }
+        
+        contiguous = size() - index;
+        return second + (index - firstSize);
+    }
+    
+    /** Splits numSamples starting at startIndex of a ring of ringSize samples */
+    static DelaySpans fromRing (Type* data, size_t ringSize, size_t startIndex, size_t numSamples) noexcept
+    {
+        jassert (startIndex < ringSize && numSamples <= ringSize);
+        
+        auto firstSize = juce::jmin (numSamples, ringSize - startIndex);
+        return { data + startIndex, firstSize, data, numSamples - firstSize };
+    }
+};
+
+//==============================================================================
+/**
+    A single-channel ring buffer.
+
+    The storage is rounded up to a power of two so every index can be wrapped
+    with a bitmask, and the write position is a counter that only ever
+    increases. size() is the logical maximum delay the line was sized for,
+    capacity() the physical length of the storage behind it.
+*/
 template <typename Type>
 class DelayLine
 {
 public:
+    /** Spans of any length up to size() */
+    static constexpr size_t maxSpanSize = std::numeric_limits<size_t>::max();
+    
     /* fills delay line with 0's */
     void clear() noexcept
     {
         std::fill (rawData.begin(), rawData.end(), Type (0));
     }
     
+    /** The longest delay (in samples) that can be read back */
     size_t size() const noexcept
+    {
+        return maxDelay;
+    }
+    
+    /** The number of samples actually allocated, always a power of two >= size() */
+    size_t capacity() const noexcept
     {
         return rawData.size();
     }
     
     void resize (size_t newValue)
     {
-        rawData.resize (newValue);
-        readIndex = 0;
+        maxDelay = newValue;
+        rawData.resize ((size_t) juce::nextPowerOfTwo ((int) juce::jmax ((size_t) 1, newValue)));
+        mask = rawData.size() - 1;
+        writeCount = 0;
     }
     
-    
+    /** Returns the oldest sample that is still inside the logical size */
     Type back() const noexcept
     {
-        return rawData[readIndex];
+        return get (size() - 1);
     }
     
+    /** Returns the sample pushed delayInSamples pushes ago (0 is the most recent one) */
     Type get (size_t delayInSamples) const noexcept
     {
-        jassert (delayInSamples >= 0 && delayInSamples < size());
-        return rawData[(readIndex + 1 + delayInSamples) % size()];   // [3]
+        jassert (delayInSamples < size());
+        return rawData[(writeCount - 1 - delayInSamples) & mask];
     }
     
     /** Set the specified sample in the delay line */
     void set (size_t delayInSamples, Type newValue) noexcept
     {
-        jassert (delayInSamples >= 0 && delayInSamples < size());
-        
-        rawData[(readIndex + 1 + delayInSamples) % size()] = newValue; // [4]
+        jassert (delayInSamples < size());
+        rawData[(writeCount - 1 - delayInSamples) & mask] = newValue;
     }
     
-    /** Adds a new value to the delay line, changing the head index to the least recently added sample */
+    /** Adds a new value to the delay line, overwriting the oldest sample in the storage */
     void push (Type valueToAdd) noexcept
     {
-        rawData[readIndex] = valueToAdd;
-      
-        if (readIndex == 0)
-        {
-            /* end of buffer */
-            readIndex = size() - 1;
-        }
-        else
-        {
-            /* get index that is before the current index? */
-            readIndex = readIndex - 1;
-        }
-        readIndex = readIndex == 0 ? size() - 1 : readIndex - 1;
+        rawData[writeCount & mask] = valueToAdd;
+        ++writeCount;
+    }
+    
+    //==============================================================================
+    /**
+        Returns the storage the next numSamples pushes would write to. Fill it,
+        then call advance (numSamples) to make the samples visible to readers.
+    */
+    DelaySpans<Type> getWriteSpans (size_t numSamples) noexcept
+    {
+        return DelaySpans<Type>::fromRing (rawData.data(), capacity(), writeCount & mask, numSamples);
+    }
+    
+    /**
+        Returns the samples get (delayInSamples) would return over the next
+        numSamples pushes. Those samples must already be in the line, so
+        numSamples can be at most delayInSamples + 1.
+    */
+    DelaySpans<const Type> getReadSpans (size_t delayInSamples, size_t numSamples) const noexcept
+    {
+        jassert (delayInSamples < size() && numSamples <= delayInSamples + 1);
+        
+        return DelaySpans<const Type>::fromRing (rawData.data(), capacity(),
+                                                 (writeCount - 1 - delayInSamples) & mask, numSamples);
+    }
+    
+    /** Moves the write position on after a block was written through getWriteSpans() */
+    void advance (size_t numSamples) noexcept
+    {
+        writeCount += numSamples;
     }
     
 private:
    
     std::vector<Type> rawData;
-    size_t readIndex = 0;
+    size_t maxDelay = 0;
+    size_t mask = 0;
+    
+    /* never wraps in practice, only the masked value is used as an index */
+    size_t writeCount = 0;
 };
 
 //==============================================================================
-template <typename Type, size_t maxNumChannels = 2>
+/**
+    A multichannel feedback delay. The saturator in the feedback path and the
+    fractional-delay interpolation are picked at compile time, see
+    Saturation.h and Interpolation.h. So is the delay memory: DelayLine, or
+    PagedDelayLine for delays of minutes.
+
+    The saturator can also run oversampled, see setOversampling(), and the
+    feedback path can be damped, see setDamping().
+*/
+template <typename Type, size_t maxNumChannels = 2,
+          typename Saturator = Saturation::Tanh,
+          typename InterpolationType = Interpolation::None,
+          typename Storage = DelayLine<Type>>
 class Delay
 {
 public:
+    using OversamplingFilter = typename OversampledSaturator<Type, Saturator>::Filter;
+    
     //==============================================================================
     Delay()
     {
         setMaxDelayTime (2.0f);
-        setDelayTime (0, 0.7f);
-        setDelayTime (1, 0.5f);
+        
+        for (size_t ch = 0; ch < maxNumChannels; ++ch)
+            setDelayTime (ch, ch == 0 ? 0.7f : 0.5f);
+        
         setWetLevel (0.8f);
         setFeedback (0.5f);
     }
@@ -95,7 +202,16 @@ public:
     {
         jassert (spec.numChannels <= maxNumChannels);
         sampleRate = (Type) spec.sampleRate;
+        Saturator::template prepare<Type>();
         updateDelayLineSize();
+        
+        for (auto& saturator : saturators)
+            saturator.prepare (oversamplingFactorLog2, oversamplingFilter, spec.maximumBlockSize);
+        
+        loopLatency = saturators[0].getLatencySamples();
+        updateDampingCoefficients();
+        feedbackScratch.assign (oversamplingFactorLog2 > 0 ? (size_t) spec.maximumBlockSize : 0, Type (0));
+        
         updateDelayTime();
    
     }
@@ -105,6 +221,14 @@ public:
     {
        for (auto& dline : delayLines)
             dline.clear();
+        
+        for (auto& reader : readers)
+            reader.reset();
+        
+        for (auto& saturator : saturators)
+            saturator.reset();
+        
+        dampingStates.fill ({});
     }
     
     //==============================================================================
@@ -135,6 +259,44 @@ public:
         wetLevel = newValue;
     }
     
+    //==============================================================================
+    /**
+        Runs the feedback saturator at 2, 4 or 8 times the sample rate
+        (factorLog2 1, 2 or 3) to keep heavy feedback from aliasing; 0 runs
+        it at the base rate. Takes effect at the next prepare().
+        
+        The output is not delayed: the filters' latency sits inside the
+        feedback loop and is taken off every read head, which makes it the
+        shortest delay the line can produce (see getLoopLatencySamples()).
+    */
+    void setOversampling (size_t factorLog2, OversamplingFilter filter = OversamplingFilter::iir)
+    {
+        jassert (factorLog2 <= 3);
+        oversamplingFactorLog2 = juce::jmin (factorLog2, (size_t) 3);
+        oversamplingFilter = filter;
+    }
+    
+    /** The oversampling filters' latency, taken off the read heads; 0 without oversampling */
+    size_t getLoopLatencySamples() const noexcept
+    {
+        return loopLatency;
+    }
+    
+    //==============================================================================
+    /**
+        Filters what is fed back, so each repeat is darker (lowpass) or
+        thinner (highpass) than the last; the first repeat is left as it is.
+        q only applies to the biquad modes. The coefficients are worked out
+        here and in prepare(), never per block.
+    */
+    void setDamping (Damping::Mode newMode, Type newCutoffHz, Type newQ = Type (0.70710678))
+    {
+        dampingMode = newMode;
+        dampingCutoff = newCutoffHz;
+        dampingQ = newQ;
+        updateDampingCoefficients();
+    }
+    
     //==============================================================================
     void setDelayTime (size_t channel, Type newValue)
     {
@@ -168,61 +330,31 @@ public:
         {
             auto* input  = inputBlock .getChannelPointer (ch);
             auto* output = outputBlock.getChannelPointer (ch);
-            auto& dline = delayLines[ch];
-            auto& dTime = delayTimeInSamples[ch];
             
-          
-            
-            for (size_t i = 0; i < numSamples; ++i)
-            {
-                /* get sample from dline that is dTime samples back */
-                auto delayedSample = dline.get (dTime);
-                auto nextDelayedSample = dline.get(dTime + 1);
-                
-                /* reference to current dry input sample */
-                auto inputSample = input[i];
-                
-                /* readIndex is now equal to the index that is dTime (in samples) back */
-                readIndex = validateReadPosition (writeIndex - dTime);
-                
-                /* gives me a percent into the next index */
-                readIndexFraction = readIndex - (long)readIndex;
-                
-                /* calculate how far into the change between samples we are and adds that to the delayedSample  */
-                const float interpSample = delayedSample + (readIndexFraction * (nextDelayedSample - delayedSample));
-                
-                
-                auto dlineInputSample = std::tanh (inputSample + feedback * interpSample);
-                
-                dline.push (dlineInputSample);
-                
-                /*
-                    output inputSample + delayedSample, where
-                    delayedSample is scaled by wetLevel.
-                    Should I scale inputSample too?
-                    Don't need to use interpSample because we already
-                    interpolated as it went to the delayBuffer
-                */
-                auto outputSample = inputSample + wetLevel * delayedSample;
-                
-                output[i] = outputSample;
-                
-                /* increment writeIndex until it hits maxDelay size, then set to 0 */
-                writeIndex = writeIndex != maxDelayInSamples - 1 ? writeIndex + 1 : 0;
-            }
+            /* the damping filter's order picks the loop, so no damping costs nothing */
+            Damping::withSection (dampingCoefficients, dampingStates[ch], [&] (auto damping)
+            {
+                processChannel (ch, input, output, numSamples, damping);
+            });
         }
     }
     
 private:
     //==============================================================================
-    std::array<DelayLine<Type>, maxNumChannels> delayLines; // array of delay lines
-    std::array<size_t, maxNumChannels> delayTimeInSamples; // array of delay times in samples
-    std::array<Type, maxNumChannels> delayTime; // array of delay times in sec
+    std::array<Storage, maxNumChannels> delayLines; // array of delay lines
+    std::array<typename InterpolationType::template Reader<Type>, maxNumChannels> readers; // delay time in samples, per channel
+    std::array<OversampledSaturator<Type, Saturator>, maxNumChannels> saturators;
+    std::vector<Type> feedbackScratch;  // one chunk of the feedback path, saturated as a block
+    size_t oversamplingFactorLog2 = 0;
+    OversamplingFilter oversamplingFilter = OversamplingFilter::iir;
+    size_t loopLatency = 0;
+    Damping::Mode dampingMode = Damping::Mode::off;
+    Type dampingCutoff { Type (5000) }, dampingQ { Type (0.70710678) };
+    Damping::Coefficients<Type> dampingCoefficients;
+    std::array<Damping::State<Type>, maxNumChannels> dampingStates;
+    std::array<Type, maxNumChannels> delayTime {}; // array of delay times in sec
     Type feedback { Type (0) };
     Type wetLevel { Type (0) };
-    float readIndex {0.f}, readIndexFraction {0.f};
-    long maxDelayInSamples {0}, writeIndex {0};
-
     
     Type sampleRate   { Type (44.1e3) };
     Type maxDelayTime { Type (2) };
@@ -239,9 +371,17 @@ private:
         /*
             make a bunch of delayLines at the specified size
             delayLines = numChannels
+            + 1 so a delay of exactly maxDelayTime can still be read back,
+            plus the samples the interpolation reads past it
          */
         for (auto& dline : delayLines)
-            dline.resize (delayLineSizeSamples);
+            dline.resize (delayLineSizeSamples + 1 + InterpolationType::lookahead);
+    }
+    
+    //==============================================================================
+    void updateDampingCoefficients() noexcept
+    {
+        dampingCoefficients = Damping::Coefficients<Type>::make (dampingMode, (double) dampingCutoff, (double) dampingQ, (double) sampleRate);
     }
     
     //==============================================================================
@@ -249,32 +389,140 @@ private:
     {
         /* set delayTime for each Channel */
         for (size_t ch = 0; ch < maxNumChannels; ++ch)
-            delayTimeInSamples[ch] = (size_t) juce::roundToInt (delayTime[ch] * sampleRate);
+            readers[ch].setDelay (juce::jmax (Type (0), delayTime[ch] * sampleRate - (Type) loopLatency));
     }
     
-   
+    //==============================================================================
+    template <typename DampingSection>
+    void processChannel (size_t ch, const Type* input, Type* output, size_t numSamples, DampingSection& damping) noexcept
+    {
+        auto& dline = delayLines[ch];
+        auto& reader = readers[ch];
+        
+        if (saturators[ch].isEnabled())
+        {
+            processOversampled (ch, input, output, numSamples, damping);
+            return;
+        }
+        
+        if constexpr (! InterpolationType::isInteger)
+        {
+            for (size_t i = 0; i < numSamples; ++i)
+            {
+                auto inputSample   = input[i];
+                auto delayedSample = reader.read (dline);
+                
+                dline.push (Saturator::process (inputSample + feedback * damping.process (delayedSample)));
+                output[i] = inputSample + wetLevel * delayedSample;
+            }
+            
+            return;
+        }
+        
+        auto dTime = reader.getIntegerDelay();
+        
+        /*
+            Work in chunks of at most dTime + 1 samples: nothing written
+            during a chunk is read back inside it, so each chunk is one
+            block read and one block write on the delay line. Paged
+            storage caps the chunks further, at a page.
+        */
+        for (size_t done = 0; done < numSamples;)
+        {
+            auto chunk = juce::jmin (numSamples - done, dTime + 1, Storage::maxSpanSize);
+            auto readSpans  = dline.getReadSpans (dTime, chunk);
+            auto writeSpans = dline.getWriteSpans (chunk);
+            
+            /* the read and write ranges wrap at different points, so walk them run by run */
+            for (size_t i = 0; i < chunk;)
+            {
+                size_t readRun, writeRun;
+                auto* delayed = readSpans .at (i, readRun);
+                auto* dest    = writeSpans.at (i, writeRun);
+                auto run = juce::jmin (readRun, writeRun);
+                
+                processRun (input + done + i, output + done + i, delayed, dest, run, damping);
+                i += run;
+            }
+            
+            dline.advance (chunk);
+            done += chunk;
+        }
+    }
     
-    // Ensure the read position is above 0 and less than the maximum delay amount
-    inline float validateReadPosition (float readPosition)
+    //==============================================================================
+    /*
+        The per-sample work on plain pointers: delayed is read from the line,
+        dest is where this run of samples gets written back into it.
+    */
+    template <typename DampingSection>
+    void processRun (const Type* input, Type* output, const Type* delayed, Type* dest, size_t numSamples,
+                     DampingSection& damping) noexcept
     {
-        /* first time readPosition is negative */
-        if (readPosition >= 0.f)
+        for (size_t i = 0; i < numSamples; ++i)
         {
-            if (readPosition < maxDelayInSamples)
-                return readPosition;
+            auto inputSample   = input[i];
+            auto delayedSample = delayed[i];
+            
+            dest[i] = Saturator::process (inputSample + feedback * damping.process (delayedSample));
             
             /*
-                maxDelayInSamples is buffer size so subtracting it
-                is essentially a modulo
+                output inputSample + delayedSample, where
+                delayedSample is scaled by wetLevel.
+                Should I scale inputSample too?
             */
-            return readPosition - maxDelayInSamples;
+            output[i] = inputSample + wetLevel * delayedSample;
         }
-        /*
-            Read position has undershot, wrap forward.
-            maxDelayInSamples should be the size of the
-            delayBuffer
-        */
-        return readPosition + maxDelayInSamples;
+    }
+    
+    //==============================================================================
+    /* a delay line as it will be offset pushes from now, so a chunk can be read before it is written */
+    struct LineAhead
+    {
+        const Storage& line;
+        size_t offset;
+        
+        Type get (size_t delayInSamples) const noexcept
+        {
+            return line.get (delayInSamples - offset);
+        }
+    };
+    
+    /*
+        The oversampled saturator wants whole blocks, so each chunk is read
+        first, saturated in one go, and only then pushed. A chunk therefore
+        can't be longer than the nearest sample the reader looks at.
+    */
+    template <typename DampingSection>
+    void processOversampled (size_t ch, const Type* input, Type* output, size_t numSamples,
+                             DampingSection& damping) noexcept
+    {
+        auto& dline = delayLines[ch];
+        auto& reader = readers[ch];
+        auto* feedbackPath = feedbackScratch.data();
+        
+        const auto reach = InterpolationType::isInteger ? reader.getIntegerDelay() + 1 : reader.getIntegerDelay();
+        const auto maxChunk = juce::jmin (feedbackScratch.size(), juce::jmax ((size_t) 1, reach));
+        
+        for (size_t done = 0; done < numSamples;)
+        {
+            auto chunk = juce::jmin (numSamples - done, maxChunk);
+            
+            for (size_t i = 0; i < chunk; ++i)
+            {
+                auto inputSample   = input[done + i];
+                auto delayedSample = reader.read (LineAhead { dline, i });
+                
+                feedbackPath[i] = inputSample + feedback * damping.process (delayedSample);
+                output[done + i] = inputSample + wetLevel * delayedSample;
+            }
+            
+            saturators[ch].process (feedbackPath, chunk);
+            
+            for (size_t i = 0; i < chunk; ++i)
+                dline.push (feedbackPath[i]);
+            
+            done += chunk;
+        }
     }
 };
-
@@ -0,0 +1,345 @@
+/*
+  ==============================================================================
+
+    DenseTaps.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "MultiTap.h"
+
+#include <complex>
+
+//==============================================================================
+/**
+    Hundreds of feed-forward taps (granular clouds, imported tap maps) read out
+    of the same delay memory as MultiTap. The taps together form a sparse FIR
+    filter, which runs either directly, like MultiTap, or as a uniformly
+    partitioned FFT convolution, whichever the cost model below says is
+    cheaper.
+
+    The convolution works on partitions of B samples with FFTs of 2B
+    (overlap-save), and only the partitions that hold a tap are stored and
+    multiplied. A partitioned convolution has a latency of B; the engine
+    hides it by shifting the taps at B samples or more forward by B, and
+    summing the taps shorter than B directly. getLatencySamples() is
+    therefore 0.
+
+    Everything is allocated in the constructor, so build a new engine off
+    the audio thread whenever the taps, the sample rate or the layout change.
+    The delay memory can be float or double; the convolution itself always
+    runs in float.
+*/
+class DenseTaps
+{
+public:
+    enum class Mode { automatic, direct, fft };
+
+    static constexpr int maxNumChannels = 16;
+    static constexpr int maxNumTaps = 4096;
+
+    //==============================================================================
+    DenseTaps (const std::vector<DelayTap>& taps, double sampleRate, int newNumChannels,
+               const float* speakerPositions, int maxDelaySamples, Mode mode = Mode::automatic)
+        : numChannels (juce::jlimit (0, maxNumChannels, newNumChannels))
+    {
+        jassert (taps.size() <= (size_t) maxNumTaps);
+
+        for (size_t t = 0; t < juce::jmin (taps.size(), (size_t) maxNumTaps); ++t)
+        {
+            auto& tap = taps[t];
+            const auto delay = juce::jlimit (0, maxDelaySamples, juce::roundToInt (tap.delayMs * sampleRate / 1000.0));
+            const auto angle = (juce::jlimit (-1.0f, 1.0f, tap.pan) + 1.0f) * juce::MathConstants<float>::pi * 0.25f;
+
+            /* same equal-power law as MultiTap */
+            std::array<float, maxNumChannels> gains {};
+
+            for (int ch = 0; ch < numChannels; ++ch)
+                gains[(size_t) ch] = tap.gain * (speakerPositions[ch] < 0.0f ? std::cos (angle)
+                                               : speakerPositions[ch] > 0.0f ? std::sin (angle)
+                                                                             : 1.0f);
+
+            allTaps.push_back ({ delay, gains });
+        }
+
+        partitionSize = mode == Mode::direct ? 0 : choosePartitionSize (mode == Mode::fft);
+
+        for (auto& tap : allTaps)
+            if (tap.delay < partitionSize || partitionSize == 0)
+                directTaps.push_back (tap);
+
+        if (partitionSize > 0)
+            preparePartitions();
+    }
+
+    //==============================================================================
+    bool isActive() const noexcept              { return ! allTaps.empty(); }
+
+    /** 0 when the taps are summed directly */
+    int getPartitionSize() const noexcept       { return partitionSize; }
+
+    int getLatencySamples() const noexcept      { return 0; }
+
+    //==============================================================================
+    /**
+        Cost model, in real multiply-adds per sample and channel. Summing taps
+        directly costs one per tap. The convolution costs a forward and an
+        inverse real FFT of 2B points and one complex multiply-add per bin
+        and stored partition, all spread over the B samples of a partition.
+
+        fftCostPerPoint is on the high side on purpose: the direct sums are
+        plain vectorised loops, while an FFT moves data around far more.
+    */
+    static constexpr double fftCostPerPoint = 2.5;
+
+    static double getDirectCost (int numTaps) noexcept
+    {
+        return (double) numTaps;
+    }
+
+    static double getConvolutionCost (int blockSize, int numActivePartitions, int numShortTaps) noexcept
+    {
+        const auto fftSize = 2.0 * blockSize;
+        const auto transforms = 2.0 * fftCostPerPoint * fftSize * std::log2 (fftSize);
+        const auto spectra = 4.0 * numActivePartitions * (blockSize + 1);
+
+        return (transforms + spectra) / blockSize + numShortTaps;
+    }
+
+    //==============================================================================
+    /**
+        Adds the taps for the numSamples that start at writePos in delayBuffer
+        to outputs (one per channel), like MultiTap::process().
+    */
+    template <typename SampleType>
+    void process (const juce::AudioBuffer<SampleType>& delayBuffer, int writePos,
+                  SampleType* const* outputs, int numSamples) noexcept
+    {
+        const auto ringSize = delayBuffer.getNumSamples();
+        const auto mask = ringSize - 1;
+        const auto channelsToProcess = juce::jmin (numChannels, delayBuffer.getNumChannels());
+
+        jassert (juce::isPowerOfTwo (ringSize));
+
+        for (int ch = 0; ch < channelsToProcess; ++ch)
+        {
+            const auto* data = delayBuffer.getReadPointer (ch);
+
+            for (auto& tap : directTaps)
+            {
+                const auto gain = (SampleType) tap.gains[(size_t) ch];
+
+                if (gain == SampleType (0))
+                    continue;
+
+                const auto spans = DelaySpans<const SampleType>::fromRing (data, (size_t) ringSize,
+                                                                      (size_t) ((writePos - tap.delay) & mask),
+                                                                      (size_t) numSamples);
+
+                juce::FloatVectorOperations::addWithMultiply (outputs[ch], spans.first, gain, (int) spans.firstSize);
+
+                if (spans.secondSize > 0)
+                    juce::FloatVectorOperations::addWithMultiply (outputs[ch] + spans.firstSize, spans.second, gain, (int) spans.secondSize);
+            }
+        }
+
+        if (partitionSize == 0)
+            return;
+
+        /* feed the convolution a partition at a time; its output runs one partition behind */
+        for (int done = 0; done < numSamples;)
+        {
+            const auto runLength = juce::jmin (numSamples - done, partitionSize - framePosition);
+            const auto readPos = (writePos + done) & mask;
+
+            for (int ch = 0; ch < channelsToProcess; ++ch)
+            {
+                auto& state = channels[(size_t) ch];
+                const auto spans = DelaySpans<const SampleType>::fromRing (delayBuffer.getReadPointer (ch), (size_t) ringSize,
+                                                                           (size_t) readPos, (size_t) runLength);
+
+                auto* input = state.inputFrame.data() + partitionSize + framePosition;
+                copyToFrame (input, spans.first, spans.firstSize);
+                copyToFrame (input + spans.firstSize, spans.second, spans.secondSize);
+
+                addFromFrame (outputs[ch] + done, state.outputFrame.data() + framePosition, runLength);
+            }
+
+            framePosition += runLength;
+            done += runLength;
+
+            if (framePosition == partitionSize)
+            {
+                for (int ch = 0; ch < channelsToProcess; ++ch)
+                    convolvePartition (channels[(size_t) ch]);
+
+                inputSlot = (inputSlot + 1) % numInputSlots;
+                framePosition = 0;
+            }
+        }
+    }
+
+private:
+    //==============================================================================
+    struct Tap
+    {
+        int delay;
+        std::array<float, maxNumChannels> gains;
+    };
+
+    struct ChannelState
+    {
+        std::vector<std::complex<float>> filterSpectra;     // numBins per stored partition
+        std::vector<std::complex<float>> inputSpectra;      // numBins per slot of the frequency delay line
+        std::vector<float> inputFrame;                      // the previous and the current partition of input
+        std::vector<float> outputFrame;                     // one partition of output, played back while the next fills
+    };
+
+    int numChannels = 0;
+    std::vector<Tap> allTaps, directTaps;
+
+    int partitionSize = 0, fftSize = 0, numBins = 0;
+    std::unique_ptr<juce::dsp::FFT> fft;
+    std::vector<int> activePartitions;                      // partitions of the shifted taps that hold a tap
+    int numInputSlots = 1, inputSlot = 0, framePosition = 0;
+
+    std::vector<ChannelState> channels;
+    std::vector<std::complex<float>> workspace;             // fftSize complex values, as dsp::FFT wants for real transforms
+
+    //==============================================================================
+    template <typename SampleType>
+    static void copyToFrame (float* frame, const SampleType* source, size_t numSamples) noexcept
+    {
+        if constexpr (std::is_same<SampleType, float>::value)
+            juce::FloatVectorOperations::copy (frame, source, (int) numSamples);
+        else
+            for (size_t i = 0; i < numSamples; ++i)
+                frame[i] = (float) source[i];
+    }
+
+    template <typename SampleType>
+    static void addFromFrame (SampleType* dest, const float* frame, int numSamples) noexcept
+    {
+        if constexpr (std::is_same<SampleType, float>::value)
+            juce::FloatVectorOperations::add (dest, frame, numSamples);
+        else
+            for (int i = 0; i < numSamples; ++i)
+                dest[i] += (SampleType) frame[i];
+    }
+
+    //==============================================================================
+    std::vector<int> findActivePartitions (int blockSize) const
+    {
+        std::vector<int> partitions;
+
+        for (auto& tap : allTaps)
+            if (tap.delay >= blockSize)
+                partitions.push_back ((tap.delay - blockSize) / blockSize);
+
+        std::sort (partitions.begin(), partitions.end());
+        partitions.erase (std::unique (partitions.begin(), partitions.end()), partitions.end());
+        return partitions;
+    }
+
+    int countShortTaps (int blockSize) const
+    {
+        return (int) std::count_if (allTaps.begin(), allTaps.end(), [blockSize] (const Tap& t) { return t.delay < blockSize; });
+    }
+
+    /* 0 keeps the direct sums; forceConvolution picks the cheapest partition size regardless */
+    int choosePartitionSize (bool forceConvolution) const
+    {
+        auto bestCost = forceConvolution ? std::numeric_limits<double>::max() : getDirectCost ((int) allTaps.size());
+        auto bestSize = 0;
+
+        for (int order = 6; order <= 12; ++order)
+        {
+            const auto blockSize = 1 << order;
+            const auto cost = getConvolutionCost (blockSize, (int) findActivePartitions (blockSize).size(), countShortTaps (blockSize));
+
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestSize = blockSize;
+            }
+        }
+
+        return bestSize;
+    }
+
+    //==============================================================================
+    void preparePartitions()
+    {
+        fftSize = 2 * partitionSize;
+        numBins = partitionSize + 1;
+        fft = std::make_unique<juce::dsp::FFT> (juce::roundToInt (std::log2 (fftSize)));
+        workspace.assign ((size_t) fftSize, {});
+
+        activePartitions = findActivePartitions (partitionSize);
+        numInputSlots = activePartitions.empty() ? 1 : activePartitions.back() + 1;
+
+        channels.resize ((size_t) numChannels);
+
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            auto& state = channels[(size_t) ch];
+            state.filterSpectra.assign (activePartitions.size() * (size_t) numBins, {});
+            state.inputSpectra.assign ((size_t) (numInputSlots * numBins), {});
+            state.inputFrame.assign ((size_t) fftSize, 0.0f);
+            state.outputFrame.assign ((size_t) partitionSize, 0.0f);
+
+            for (size_t p = 0; p < activePartitions.size(); ++p)
+            {
+                auto* time = reinterpret_cast<float*> (workspace.data());
+                std::fill (workspace.begin(), workspace.end(), std::complex<float>());
+
+                const auto start = partitionSize + activePartitions[p] * partitionSize;
+
+                for (auto& tap : allTaps)
+                    if (tap.delay >= start && tap.delay < start + partitionSize)
+                        time[tap.delay - start] += tap.gains[(size_t) ch];
+
+                fft->performRealOnlyForwardTransform (time, true);
+                std::copy (workspace.begin(), workspace.begin() + numBins, state.filterSpectra.begin() + (std::ptrdiff_t) p * numBins);
+            }
+        }
+    }
+
+    /* overlap-save for one channel: spectrum of the last two partitions of input, times every stored filter partition */
+    void convolvePartition (ChannelState& state) noexcept
+    {
+        auto* time = reinterpret_cast<float*> (workspace.data());
+
+        std::copy (state.inputFrame.begin(), state.inputFrame.end(), time);
+        std::fill (time + fftSize, time + 2 * fftSize, 0.0f);
+        fft->performRealOnlyForwardTransform (time, true);
+
+        auto* newest = state.inputSpectra.data() + inputSlot * numBins;
+        std::copy (workspace.begin(), workspace.begin() + numBins, newest);
+
+        std::fill (workspace.begin(), workspace.end(), std::complex<float>());
+
+        for (size_t p = 0; p < activePartitions.size(); ++p)
+        {
+            const auto slot = (inputSlot - activePartitions[p] + numInputSlots) % numInputSlots;
+            const auto* input  = state.inputSpectra.data() + slot * numBins;
+            const auto* filter = state.filterSpectra.data() + (int) p * numBins;
+
+            for (int bin = 0; bin < numBins; ++bin)
+                workspace[(size_t) bin] += input[bin] * filter[bin];
+        }
+
+        /* the inverse transform wants the negative frequencies as well */
+        for (int bin = 1; bin < partitionSize; ++bin)
+            workspace[(size_t) (fftSize - bin)] = std::conj (workspace[(size_t) bin]);
+
+        fft->performRealOnlyInverseTransform (time);
+
+        std::copy (time + partitionSize, time + fftSize, state.outputFrame.begin());
+        std::copy (state.inputFrame.begin() + partitionSize, state.inputFrame.end(), state.inputFrame.begin());
+    }
+
+    JUCE_DECLARE_NON_COPYABLE (DenseTaps)
+};
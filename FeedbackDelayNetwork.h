@@ -0,0 +1,329 @@
+/*
+  ==============================================================================
+
+    FeedbackDelayNetwork.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "Delay.h"
+
+//==============================================================================
+/**
+    Orthogonal feedback matrices for FeedbackDelayNetwork, picked at compile
+    time. Each one mixes a block of samples from every line in place, one
+    whole line-array at a time, so the inner loops run over samples and
+    vectorise; the matrix itself is never stored.
+*/
+namespace Mixing
+{
+    /**
+        The Walsh-Hadamard matrix, scaled to be orthonormal: every line feeds
+        every other with the same weight, in N log2 N adds per sample. N must
+        be a power of two.
+    */
+    struct Hadamard
+    {
+        template <typename Type, size_t numLines>
+        static void process (const std::array<Type*, numLines>& lines, Type* /*scratch*/, size_t numSamples) noexcept
+        {
+            static_assert (juce::isPowerOfTwo (numLines), "Hadamard mixing needs a power of two lines");
+
+            for (size_t half = 1; half < numLines; half *= 2)
+            {
+                for (size_t start = 0; start < numLines; start += 2 * half)
+                {
+                    for (size_t k = start; k < start + half; ++k)
+                    {
+                        auto* a = lines[k];
+                        auto* b = lines[k + half];
+
+                        for (size_t i = 0; i < numSamples; ++i)
+                        {
+                            auto x = a[i], y = b[i];
+                            a[i] = x + y;
+                            b[i] = x - y;
+                        }
+                    }
+                }
+            }
+        }
+
+        /** The 1 / sqrt (N) the transform leaves out, for the caller to fold into its feedback gain */
+        template <typename Type, size_t numLines>
+        static Type getNormalisation() noexcept
+        {
+            return Type (1) / std::sqrt (Type (numLines));
+        }
+    };
+
+    /**
+        The Householder reflection I - 2/N: each line keeps most of itself and
+        takes an equal share of the others, in about 2N operations per sample.
+        Mixes less densely than Hadamard, and works for any N.
+    */
+    struct Householder
+    {
+        template <typename Type, size_t numLines>
+        static void process (const std::array<Type*, numLines>& lines, Type* scratch, size_t numSamples) noexcept
+        {
+            std::fill (scratch, scratch + numSamples, Type (0));
+
+            for (auto* line : lines)
+                for (size_t i = 0; i < numSamples; ++i)
+                    scratch[i] += line[i];
+
+            const auto reflection = Type (2) / Type (numLines);
+
+            for (auto* line : lines)
+                for (size_t i = 0; i < numSamples; ++i)
+                    line[i] -= reflection * scratch[i];
+        }
+
+        template <typename Type, size_t numLines>
+        static Type getNormalisation() noexcept
+        {
+            return Type (1);
+        }
+    };
+}
+
+//==============================================================================
+/**
+    numLines DelayLines cross-coupled through an orthogonal Mixing matrix,
+    which turns the delay into a diffuse reverb. Because the matrix is
+    orthogonal, the loop is stable for any feedback up to 1 (with 1 the
+    tail never decays).
+
+    Input channel c feeds the lines c, c + C, c + 2C... of a C-channel
+    block, and output channel c is made from the same lines with
+    alternating signs, so the channels stay decorrelated.
+
+    Like Delay's span path, the network works in chunks no longer than its
+    shortest line: each chunk is read from every line, mixed as a block,
+    damped (see Damping.h) and written back.
+*/
+template <typename Type, size_t numLines = 8, typename MixingType = Mixing::Hadamard>
+class FeedbackDelayNetwork
+{
+public:
+    //==============================================================================
+    FeedbackDelayNetwork()
+    {
+        setMaxDelayTime (Type (0.5));
+        spreadDelayTimes (Type (0.03), Type (0.09));
+        setFeedback (Type (0.85));
+        setWetLevel (Type (0.3));
+    }
+
+    //==============================================================================
+    void prepare (const juce::dsp::ProcessSpec& spec)
+    {
+        jassert (spec.numChannels >= 1 && spec.numChannels <= numLines);
+
+        sampleRate = (Type) spec.sampleRate;
+
+        for (auto& line : lines)
+            line.resize ((size_t) std::ceil (maxDelayTime * sampleRate) + 1);
+
+        for (auto& block : lineBlocks)
+            block.assign ((size_t) spec.maximumBlockSize, Type (0));
+
+        for (auto& block : wetBlocks)
+            block.assign ((size_t) spec.maximumBlockSize, Type (0));
+
+        mixingScratch.assign ((size_t) spec.maximumBlockSize, Type (0));
+        updateDampingCoefficients();
+        updateDelayTimes();
+    }
+
+    void reset() noexcept
+    {
+        for (auto& line : lines)
+            line.clear();
+
+        dampingStates.fill ({});
+    }
+
+    size_t getNumLines() const noexcept
+    {
+        return numLines;
+    }
+
+    //==============================================================================
+    void setMaxDelayTime (Type newValue)
+    {
+        jassert (newValue > Type (0));
+        maxDelayTime = newValue;
+    }
+
+    void setDelayTime (size_t line, Type newValue)
+    {
+        jassert (line < numLines && newValue >= Type (0) && newValue <= maxDelayTime);
+        delayTimes[line] = juce::jlimit (Type (0), maxDelayTime, newValue);
+        updateDelayTimes();
+    }
+
+    /** Spaces the lines geometrically between two times, so their lengths share no obvious ratio */
+    void spreadDelayTimes (Type shortest, Type longest)
+    {
+        for (size_t k = 0; k < numLines; ++k)
+        {
+            const auto position = numLines > 1 ? Type (k) / Type (numLines - 1) : Type (0);
+            delayTimes[k] = juce::jlimit (Type (0), maxDelayTime, shortest * std::pow (longest / shortest, position));
+        }
+
+        updateDelayTimes();
+    }
+
+    /** The gain round the loop, 0 to 1 */
+    void setFeedback (Type newValue) noexcept
+    {
+        jassert (newValue >= Type (0) && newValue <= Type (1));
+        feedback = newValue;
+    }
+
+    void setWetLevel (Type newValue) noexcept
+    {
+        jassert (newValue >= Type (0) && newValue <= Type (1));
+        wetLevel = newValue;
+    }
+
+    /** Damps every line's feedback, see Delay::setDamping() */
+    void setDamping (Damping::Mode newMode, Type newCutoffHz, Type newQ = Type (0.70710678))
+    {
+        dampingMode = newMode;
+        dampingCutoff = newCutoffHz;
+        dampingQ = newQ;
+        updateDampingCoefficients();
+    }
+
+    //==============================================================================
+    template <typename ProcessContext>
+    void process (const ProcessContext& context) noexcept
+    {
+        auto& inputBlock  = context.getInputBlock();
+        auto& outputBlock = context.getOutputBlock();
+        const auto numSamples  = outputBlock.getNumSamples();
+        const auto numChannels = juce::jmin (outputBlock.getNumChannels(), numLines);
+
+        jassert (inputBlock.getNumSamples() == numSamples);
+        jassert (inputBlock.getNumChannels() == outputBlock.getNumChannels());
+
+        std::array<Type*, numLines> mixed;
+
+        for (size_t k = 0; k < numLines; ++k)
+            mixed[k] = lineBlocks[k].data();
+
+        /* nothing written during a chunk may be read back inside it */
+        const auto maxChunk = juce::jmin (mixingScratch.size(), shortestDelay + 1);
+
+        // not prepared, or prepared for empty blocks: there's no room for a chunk at all
+        jassert (maxChunk > 0);
+
+        if (maxChunk == 0)
+            return;
+
+        const auto outputGain = Type (1) / std::sqrt (Type ((numLines + numChannels - 1) / numChannels));
+        const auto loopGain = feedback * MixingType::template getNormalisation<Type, numLines>();
+
+        for (size_t done = 0; done < numSamples;)
+        {
+            const auto chunk = juce::jmin (numSamples - done, maxChunk);
+
+            for (size_t ch = 0; ch < numChannels; ++ch)
+                std::fill (wetBlocks[ch].begin(), wetBlocks[ch].begin() + (std::ptrdiff_t) chunk, Type (0));
+
+            /* read every line, and tap the outputs before the mixing */
+            for (size_t k = 0; k < numLines; ++k)
+            {
+                copyFromSpans (lines[k].getReadSpans (delaySamples[k], chunk), mixed[k]);
+
+                const auto sign = ((k / numChannels) & 1) == 0 ? outputGain : -outputGain;
+                auto* wet = wetBlocks[k % numChannels].data();
+
+                for (size_t i = 0; i < chunk; ++i)
+                    wet[i] += sign * mixed[k][i];
+            }
+
+            MixingType::template process<Type, numLines> (mixed, mixingScratch.data(), chunk);
+
+            for (size_t k = 0; k < numLines; ++k)
+            {
+                const auto* input = inputBlock.getChannelPointer (k % numChannels) + done;
+                auto* block = mixed[k];
+
+                Damping::withSection (dampingCoefficients, dampingStates[k], [&] (auto damping)
+                {
+                    for (size_t i = 0; i < chunk; ++i)
+                        block[i] = input[i] + loopGain * damping.process (block[i]);
+                });
+
+                copyToSpans (block, lines[k].getWriteSpans (chunk));
+                lines[k].advance (chunk);
+            }
+
+            for (size_t ch = 0; ch < numChannels; ++ch)
+            {
+                const auto* input = inputBlock.getChannelPointer (ch) + done;
+                auto* output = outputBlock.getChannelPointer (ch) + done;
+                const auto* wet = wetBlocks[ch].data();
+
+                for (size_t i = 0; i < chunk; ++i)
+                    output[i] = input[i] + wetLevel * wet[i];
+            }
+
+            done += chunk;
+        }
+    }
+
+private:
+    //==============================================================================
+    std::array<DelayLine<Type>, numLines> lines;
+    std::array<Type, numLines> delayTimes {};          // seconds
+    std::array<size_t, numLines> delaySamples {};
+    size_t shortestDelay = 0;
+
+    std::array<std::vector<Type>, numLines> lineBlocks;   // one chunk per line, mixed in place
+    std::array<std::vector<Type>, numLines> wetBlocks;    // one chunk of wet signal per channel
+    std::vector<Type> mixingScratch;
+
+    Type feedback { Type (0) }, wetLevel { Type (0) };
+    Type sampleRate { Type (44.1e3) }, maxDelayTime { Type (0.5) };
+
+    Damping::Mode dampingMode = Damping::Mode::off;
+    Type dampingCutoff { Type (5000) }, dampingQ { Type (0.70710678) };
+    Damping::Coefficients<Type> dampingCoefficients;
+    std::array<Damping::State<Type>, numLines> dampingStates;
+
+    //==============================================================================
+    void updateDelayTimes() noexcept
+    {
+        shortestDelay = std::numeric_limits<size_t>::max();
+
+        for (size_t k = 0; k < numLines; ++k)
+        {
+            delaySamples[k] = (size_t) juce::roundToInt (delayTimes[k] * sampleRate);
+            shortestDelay = juce::jmin (shortestDelay, delaySamples[k]);
+        }
+    }
+
+    void updateDampingCoefficients() noexcept
+    {
+        dampingCoefficients = Damping::Coefficients<Type>::make (dampingMode, (double) dampingCutoff, (double) dampingQ, (double) sampleRate);
+    }
+
+    static void copyFromSpans (const DelaySpans<const Type>& spans, Type* dest) noexcept
+    {
+        std::copy (spans.first, spans.first + spans.firstSize, dest);
+        std::copy (spans.second, spans.second + spans.secondSize, dest + spans.firstSize);
+    }
+
+    static void copyToSpans (const Type* source, const DelaySpans<Type>& spans) noexcept
+    {
+        std::copy (source, source + spans.firstSize, spans.first);
+        std::copy (source + spans.firstSize, source + spans.size(), spans.second);
+    }
+};
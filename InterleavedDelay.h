@@ -0,0 +1,291 @@
+/*
+  ==============================================================================
+
+    InterleavedDelay.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "Saturation.h"
+
+//==============================================================================
+/**
+    A single lane with the subset of the dsp::SIMDRegister interface that
+    InterleavedDelay uses. Used as the scalar fallback when SIMD is not
+    available, and as the reference the SIMD path is checked against.
+*/
+template <typename Type>
+struct ScalarLanes
+{
+    using ElementType = Type;
+    static constexpr size_t SIMDNumElements = 1;
+
+    Type value;
+
+    static ScalarLanes expand (Type s) noexcept                  { return { s }; }
+    static ScalarLanes fromRawArray (const Type* a) noexcept     { return { *a }; }
+    void copyToRawArray (Type* a) const noexcept                 { *a = value; }
+
+    ScalarLanes operator+ (ScalarLanes other) const noexcept     { return { value + other.value }; }
+    ScalarLanes operator* (ScalarLanes other) const noexcept     { return { value * other.value }; }
+};
+
+#if JUCE_USE_SIMD
+ template <typename Type> using DefaultDelayLanes = juce::dsp::SIMDRegister<Type>;
+#else
+ template <typename Type> using DefaultDelayLanes = ScalarLanes<Type>;
+#endif
+
+//==============================================================================
+/**
+    The same feedback delay as Delay, but with the delay memory stored
+    channel-interleaved: every sample frame holds all channels next to each
+    other, padded up to a whole number of SIMD registers. Each frame is then
+    processed a register (4 or 8 channels) at a time.
+
+    Reading is a single aligned load for a group of channels that share one
+    delay time, and a gather when their delay times differ. The saturator runs
+    over the lanes of a register in a fixed-length loop, which the cheaper
+    tiers in Saturation.h let the compiler vectorise.
+*/
+template <typename Type, size_t maxNumChannels = 2,
+          typename Lanes = DefaultDelayLanes<Type>,
+          typename Saturator = Saturation::Tanh>
+class InterleavedDelay
+{
+public:
+    static constexpr size_t laneWidth = Lanes::SIMDNumElements;
+    static constexpr size_t numGroups = (maxNumChannels + laneWidth - 1) / laneWidth;
+    static constexpr size_t frameSize = numGroups * laneWidth;
+
+    //==============================================================================
+    InterleavedDelay()
+    {
+        setMaxDelayTime (2.0f);
+
+        for (size_t ch = 0; ch < maxNumChannels; ++ch)
+            setDelayTime (ch, ch == 0 ? 0.7f : 0.5f);
+
+        setWetLevel (0.8f);
+        setFeedback (0.5f);
+    }
+
+    //==============================================================================
+    void prepare (const juce::dsp::ProcessSpec& spec)
+    {
+        jassert (spec.numChannels <= maxNumChannels);
+        sampleRate = (Type) spec.sampleRate;
+        Saturator::template prepare<Type>();
+        blockFrames = juce::jmax ((size_t) 1, (size_t) spec.maximumBlockSize);
+
+        /* zeroed once: lanes past the block's channel count stay silent */
+        scratch.allocate (blockFrames * frameSize);
+
+        updateDelayLineSize();
+        updateDelayTime();
+    }
+
+    //==============================================================================
+    void reset() noexcept
+    {
+        std::fill (frames.get(), frames.get() + capacity * frameSize, Type (0));
+    }
+
+    //==============================================================================
+    size_t getNumChannels() const noexcept
+    {
+        return maxNumChannels;
+    }
+
+    //==============================================================================
+    void setMaxDelayTime (Type newValue)
+    {
+        jassert (newValue > Type (0));
+        maxDelayTime = newValue;
+        updateDelayLineSize();
+    }
+
+    //==============================================================================
+    void setFeedback (Type newValue) noexcept
+    {
+        jassert (newValue >= Type (0) && newValue <= Type (1));
+        feedback = newValue;
+    }
+
+    //==============================================================================
+    void setWetLevel (Type newValue) noexcept
+    {
+        jassert (newValue >= Type (0) && newValue <= Type (1));
+        wetLevel = newValue;
+    }
+
+    //==============================================================================
+    void setDelayTime (size_t channel, Type newValue)
+    {
+        if (channel >= getNumChannels())
+        {
+            jassertfalse;
+            return;
+        }
+
+        jassert (newValue >= Type (0));
+        delayTime[channel] = newValue;
+
+        updateDelayTime();
+    }
+
+    //==============================================================================
+    template <typename ProcessContext>
+    void process (const ProcessContext& context) noexcept
+    {
+        auto& inputBlock  = context.getInputBlock();
+        auto& outputBlock = context.getOutputBlock();
+        auto numSamples  = outputBlock.getNumSamples();
+        auto numChannels = outputBlock.getNumChannels();
+
+        jassert (inputBlock.getNumSamples() == numSamples);
+        jassert (inputBlock.getNumChannels() == numChannels);
+        jassert (numChannels <= maxNumChannels);
+
+        for (size_t start = 0; start < numSamples; start += blockFrames)
+        {
+            auto numFrames = juce::jmin (blockFrames, numSamples - start);
+            auto* block = scratch.get();
+
+            /* transpose the input into sample frames */
+            for (size_t ch = 0; ch < numChannels; ++ch)
+            {
+                auto* input = inputBlock.getChannelPointer (ch) + start;
+
+                for (size_t i = 0; i < numFrames; ++i)
+                    block[i * frameSize + ch] = input[i];
+            }
+
+            /* the output of each frame replaces its input in the scratch block */
+            for (size_t i = 0; i < numFrames; ++i)
+                processFrame (block + i * frameSize);
+
+            for (size_t ch = 0; ch < numChannels; ++ch)
+            {
+                auto* output = outputBlock.getChannelPointer (ch) + start;
+
+                for (size_t i = 0; i < numFrames; ++i)
+                    output[i] = block[i * frameSize + ch];
+            }
+        }
+    }
+
+private:
+    //==============================================================================
+    /* SIMD-aligned storage, zero-filled when allocated */
+    struct AlignedBuffer
+    {
+        void allocate (size_t numElements)
+        {
+            storage.assign (numElements + alignment / sizeof (Type), Type (0));
+
+            auto address = reinterpret_cast<std::uintptr_t> (storage.data());
+            auto offset = (alignment - (address % alignment)) % alignment;
+            data = storage.data() + offset / sizeof (Type);
+        }
+
+        Type* get() const noexcept    { return data; }
+
+        static constexpr size_t alignment = 64;
+        std::vector<Type> storage;
+        Type* data = nullptr;
+    };
+
+    AlignedBuffer frames, scratch;
+    size_t capacity = 0, mask = 0, writeCount = 0;
+    size_t blockFrames = 512;
+
+    std::array<size_t, frameSize> delayTimeInSamples {};
+    std::array<Type, maxNumChannels> delayTime {};
+    std::array<bool, numGroups> uniformGroup {};             // all lanes of the group share one delay time
+
+    Type feedback { Type (0) };
+    Type wetLevel { Type (0) };
+
+    Type sampleRate   { Type (44.1e3) };
+    Type maxDelayTime { Type (2) };
+
+    //==============================================================================
+    void processFrame (Type* frame) noexcept
+    {
+        auto* dest = frames.get() + (writeCount & mask) * frameSize;
+        auto feedbackLanes = Lanes::expand (feedback);
+        auto wetLanes      = Lanes::expand (wetLevel);
+
+        for (size_t g = 0; g < numGroups; ++g)
+        {
+            auto* lanes = frame + g * laneWidth;
+            auto input   = Lanes::fromRawArray (lanes);
+            auto delayed = readGroup (g);
+
+            alignas (AlignedBuffer::alignment) Type saturated[laneWidth];
+            (input + delayed * feedbackLanes).copyToRawArray (saturated);
+
+            for (size_t l = 0; l < laneWidth; ++l)
+                saturated[l] = Saturator::process (saturated[l]);
+
+            Lanes::fromRawArray (saturated).copyToRawArray (dest + g * laneWidth);
+            (input + delayed * wetLanes).copyToRawArray (lanes);
+        }
+
+        ++writeCount;
+    }
+
+    Lanes readGroup (size_t group) const noexcept
+    {
+        auto* data = frames.get();
+        auto firstLane = group * laneWidth;
+
+        if (uniformGroup[group])
+        {
+            auto frameIndex = (writeCount - 1 - delayTimeInSamples[firstLane]) & mask;
+            return Lanes::fromRawArray (data + frameIndex * frameSize + firstLane);
+        }
+
+        alignas (AlignedBuffer::alignment) Type gathered[laneWidth];
+
+        for (size_t l = 0; l < laneWidth; ++l)
+        {
+            auto frameIndex = (writeCount - 1 - delayTimeInSamples[firstLane + l]) & mask;
+            gathered[l] = data[frameIndex * frameSize + firstLane + l];
+        }
+
+        return Lanes::fromRawArray (gathered);
+    }
+
+    //==============================================================================
+    void updateDelayLineSize()
+    {
+        /* + 1 so a delay of exactly maxDelayTime can still be read back */
+        auto delayLineSizeSamples = (size_t) std::ceil (maxDelayTime * sampleRate) + 1;
+
+        capacity = (size_t) juce::nextPowerOfTwo ((int) delayLineSizeSamples);
+        mask = capacity - 1;
+        writeCount = 0;
+        frames.allocate (capacity * frameSize);
+    }
+
+    //==============================================================================
+    void updateDelayTime() noexcept
+    {
+        for (size_t ch = 0; ch < maxNumChannels; ++ch)
+            delayTimeInSamples[ch] = (size_t) juce::roundToInt (delayTime[ch] * sampleRate);
+
+        /* padding lanes follow the last channel so they never break up a uniform group */
+        for (size_t ch = maxNumChannels; ch < frameSize; ++ch)
+            delayTimeInSamples[ch] = delayTimeInSamples[maxNumChannels - 1];
+
+        for (size_t g = 0; g < numGroups; ++g)
+        {
+            auto* lanes = delayTimeInSamples.data() + g * laneWidth;
+            uniformGroup[g] = std::all_of (lanes, lanes + laneWidth, [lanes] (size_t d) { return d == lanes[0]; });
+        }
+    }
+};
@@ -0,0 +1,183 @@
+/*
+  ==============================================================================
+
+    MeterDisplay.cpp
+
+  ==============================================================================
+*/
+
+#include "MeterDisplay.h"
+
+//==============================================================================
+MeterDisplay::MeterDisplay (VariDelayAudioProcessor& p)
+    : audioProcessor (p),
+      summaries ((size_t) MeterCollector::fifoSize),
+      fallPerTick (Decibels::decibelsToGain (-fallDecibelsPerSecond / (float) timerHz))
+{
+    setOpaque (true);
+    startTimerHz (timerHz);
+}
+
+MeterDisplay::~MeterDisplay()
+{
+}
+
+//==============================================================================
+void MeterDisplay::timerCallback()
+{
+    const auto numSummaries = audioProcessor.getMeters().pop (summaries.data(), (int) summaries.size());
+
+    if (updateLevels (numSummaries))
+        repaint (meterArea);
+
+    if (! scope.isValid())
+        return;
+
+    /* a column covers a fixed stretch of time, however the summaries happen to be cut */
+    const auto samplesPerColumn = jmax (1.0, audioProcessor.getSampleRate() * scopeSeconds / scope.getWidth());
+    newColumns.clearQuick();
+
+    for (int i = 0; i < numSummaries; ++i)
+    {
+        const auto& summary = summaries[(size_t) i];
+        columnRange = columnRange.getUnionWith ({ summary.delayMin, summary.delayMax });
+        columnSamples += summary.numSamples;
+
+        if (columnSamples < samplesPerColumn)
+            continue;
+
+        for (; columnSamples >= samplesPerColumn; columnSamples -= samplesPerColumn)
+            newColumns.add (columnRange);
+
+        columnRange = {};
+    }
+
+    if (! newColumns.isEmpty())
+    {
+        drawNewColumns();
+        repaint (scopeArea);
+    }
+}
+
+/* instant attack and a steady fall in dB; returns false once there's nothing left to move */
+bool MeterDisplay::updateLevels (int numSummaries)
+{
+    std::array<float, numMeters> peaks {}, sumSquares {};
+    double numSamples = 0;
+
+    for (int i = 0; i < numSummaries; ++i)
+    {
+        const auto& summary = summaries[(size_t) i];
+
+        for (size_t ch = 0; ch < (size_t) MeterSummary::numChannels; ++ch)
+        {
+            const auto output = ch + (size_t) MeterSummary::numChannels;
+            peaks[ch]          = jmax (peaks[ch], summary.inputPeak[ch]);
+            peaks[output]      = jmax (peaks[output], summary.outputPeak[ch]);
+            sumSquares[ch]     += summary.inputMeanSquare[ch] * (float) summary.numSamples;
+            sumSquares[output] += summary.outputMeanSquare[ch] * (float) summary.numSamples;
+        }
+
+        numSamples += summary.numSamples;
+    }
+
+    const auto floor = Decibels::decibelsToGain (minDecibels);
+    auto changed = false;
+
+    for (size_t m = 0; m < (size_t) numMeters; ++m)
+    {
+        const auto rms = numSamples > 0 ? (float) std::sqrt (sumSquares[m] / numSamples) : 0.0f;
+
+        MeterLevel level;
+        level.peak = jmax (peaks[m], levels[m].peak * fallPerTick);
+        level.rms  = jmax (rms, levels[m].rms * fallPerTick);
+
+        // below the bottom of the meter a fall shows nothing, so stop there and let the ticks go quiet
+        if (level.peak < floor)  level.peak = 0;
+        if (level.rms  < floor)  level.rms  = 0;
+
+        changed = changed || level.peak != levels[m].peak || level.rms != levels[m].rms;
+        levels[m] = level;
+    }
+
+    return changed;
+}
+
+/* each column blanks the oldest one in the ring, so only these pixels are touched */
+void MeterDisplay::drawNewColumns()
+{
+    Graphics g (scope);
+    const auto width  = scope.getWidth();
+    const auto height = (float) scope.getHeight();
+    const auto toY = [height] (float value) { return (1.0f - jlimit (-1.0f, 1.0f, value)) * 0.5f * height; };
+
+    // more than a whole ring's worth and the older ones would be overwritten anyway
+    for (int i = jmax (0, newColumns.size() - width); i < newColumns.size(); ++i)
+    {
+        const auto range = newColumns.getReference (i);
+        const auto top = toY (range.getEnd());
+
+        g.setColour (Colours::black);
+        g.fillRect (nextColumn, 0, 1, scope.getHeight());
+        g.setColour (Colours::whitesmoke.withAlpha (0.7f));
+        g.fillRect (Rectangle<float> ((float) nextColumn, top, 1.0f, jmax (1.0f, toY (range.getStart()) - top)));
+
+        nextColumn = (nextColumn + 1) % width;
+    }
+}
+
+//==============================================================================
+void MeterDisplay::paint (Graphics& g)
+{
+    g.fillAll (Colours::black);
+
+    // the ring's oldest column is the next one to be written, so it goes on the left
+    if (scope.isValid())
+    {
+        const auto height = scope.getHeight();
+        const auto olderWidth = scope.getWidth() - nextColumn;
+
+        g.drawImage (scope, scopeArea.getX(), scopeArea.getY(), olderWidth, height, nextColumn, 0, olderWidth, height);
+
+        if (nextColumn > 0)
+            g.drawImage (scope, scopeArea.getX() + olderWidth, scopeArea.getY(), nextColumn, height, 0, 0, nextColumn, height);
+    }
+
+    const auto toProportion = [] (float gain)
+    {
+        return jlimit (0.0f, 1.0f, 1.0f - Decibels::gainToDecibels (gain, minDecibels) / minDecibels);
+    };
+
+    for (int m = 0; m < numMeters; ++m)
+    {
+        // a wider gap between the input pair and the output pair
+        const auto x = meterArea.getX() + m * (meterWidth + meterGap) + (m >= MeterSummary::numChannels ? meterGap : 0);
+        const auto bar = Rectangle<int> (x, meterArea.getY(), meterWidth, meterArea.getHeight()).toFloat();
+        const auto& level = levels[(size_t) m];
+
+        g.setColour (Colours::whitesmoke.withAlpha (0.1f));
+        g.fillRect (bar);
+
+        g.setColour (Colours::whitesmoke.darker());
+        g.fillRect (bar.withTop (bar.getBottom() - bar.getHeight() * toProportion (level.rms)));
+
+        if (level.peak > 0)
+        {
+            g.setColour (Colours::whitesmoke);
+            g.fillRect (bar.withTop (bar.getBottom() - bar.getHeight() * toProportion (level.peak)).withHeight (1.5f));
+        }
+    }
+}
+
+void MeterDisplay::resized()
+{
+    auto bounds = getLocalBounds();
+    meterArea = bounds.removeFromLeft (numMeters * (meterWidth + meterGap) + meterGap);
+    bounds.removeFromLeft (2 * meterGap);
+    scopeArea = bounds;
+
+    /* starts over blank at the new size; an RGB image is cleared to black */
+    scope = scopeArea.isEmpty() ? Image() : Image (Image::RGB, scopeArea.getWidth(), scopeArea.getHeight(), true);
+    nextColumn = 0;
+    newColumns.ensureStorageAllocated (scopeArea.getWidth());
+}
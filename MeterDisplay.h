@@ -0,0 +1,68 @@
+/*
+  ==============================================================================
+
+    MeterDisplay.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "PluginProcessor.h"
+
+//==============================================================================
+/**
+    Peak and RMS meters for the input and output, and a scrolling envelope of
+    what goes into the delay memory, fed from the processor's MeterCollector.
+
+    The envelope lives in an Image used as a ring: each timer tick draws only
+    the columns that arrived since the last one, and paint() blits the image
+    in two pieces, so nothing is scrolled or redrawn from scratch. The
+    component is opaque and only repaints what changed, so an open editor
+    costs little even when a session has dozens of them.
+*/
+class MeterDisplay  : public Component,
+                      private Timer
+{
+public:
+    explicit MeterDisplay (VariDelayAudioProcessor&);
+    ~MeterDisplay() override;
+
+    //==============================================================================
+    void paint (Graphics&) override;
+    void resized() override;
+
+private:
+    static constexpr int timerHz = 30;
+    static constexpr double scopeSeconds = 4.0;             // the delay memory's 2 s, twice over
+    static constexpr float minDecibels = -60.0f;            // the bottom of the meters
+    static constexpr float fallDecibelsPerSecond = 20.0f;   // how fast a meter drops once the level does
+
+    static constexpr int numMeters = 2 * MeterSummary::numChannels;   // input L/R, then output L/R
+    static constexpr int meterWidth = 8, meterGap = 4;
+
+    struct MeterLevel
+    {
+        float peak = 0, rms = 0;    // gains
+    };
+
+    VariDelayAudioProcessor& audioProcessor;
+
+    std::vector<MeterSummary> summaries;                    // what one tick popped, sized for a full FIFO
+    std::array<MeterLevel, numMeters> levels;
+    const float fallPerTick;
+
+    Rectangle<int> meterArea, scopeArea;
+    Image scope;
+    int nextColumn = 0;             // the ring's write position, so its oldest column too
+    double columnSamples = 0;       // gathered towards the next column, as are columnRange's bounds
+    Range<float> columnRange;
+    Array<Range<float>> newColumns; // finished this tick, oldest first
+
+    void timerCallback() override;
+    bool updateLevels (int numSummaries);
+    void drawNewColumns();
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MeterDisplay)
+};
@@ -0,0 +1,164 @@
+/*
+  ==============================================================================
+
+    Metering.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+//==============================================================================
+/** Levels over a stretch of samples, for the editor's meters and delay scope */
+struct MeterSummary
+{
+    static constexpr int numChannels = 2;   // a mono bus shows on both; a wider one shows its first two
+
+    int numSamples = 0;
+    std::array<float, numChannels> inputPeak {}, inputMeanSquare {};
+    std::array<float, numChannels> outputPeak {}, outputMeanSquare {};
+    float delayMin = 0, delayMax = 0;       // of what went into the delay memory, all channels
+};
+
+//==============================================================================
+/**
+    Summarises the processor's input, output and delay memory on the audio
+    thread and hands the summaries to the GUI through an AbstractFifo.
+
+    A summary covers whole blocks, at least samplesPerSummary of them, so
+    small blocks are merged and the FIFO sees about summariesPerSecond pushes
+    a second whatever the host does. If the GUI isn't reading, the FIFO
+    fills up and summaries are dropped: the audio thread never waits for it.
+*/
+class MeterCollector
+{
+public:
+    static constexpr int summariesPerSecond = 200;
+    static constexpr int fifoSize = 1024;   // 5 s of summaries, far more than a timer tick
+
+    MeterCollector() = default;
+
+    //==============================================================================
+    /** Call while the audio is stopped; summaries already queued stay for the GUI */
+    void prepare (double sampleRate, int newNumChannels) noexcept
+    {
+        samplesPerSummary = juce::jmax (1, juce::roundToInt (sampleRate / summariesPerSecond));
+        numChannels = newNumChannels;
+        pending = {};
+    }
+
+    /** Audio thread: measures the block before it's processed in place */
+    template <typename SampleType>
+    void measureInput (const juce::AudioBuffer<SampleType>& buffer) noexcept
+    {
+        measureLevels (buffer, pending.inputPeak, pending.inputMeanSquare);
+    }
+
+    /** Audio thread: measures the processed block and the numSamples written to the delay memory from writePos */
+    template <typename SampleType>
+    void measureOutput (const juce::AudioBuffer<SampleType>& buffer,
+                        const juce::AudioBuffer<SampleType>& delayMemory, int writePos) noexcept
+    {
+        const auto numSamples = buffer.getNumSamples();
+        measureLevels (buffer, pending.outputPeak, pending.outputMeanSquare);
+
+        /* the written region runs to the end of the memory and carries on from the start */
+        const auto memorySize = delayMemory.getNumSamples();
+        const auto firstSize  = juce::jmin (numSamples, memorySize - writePos);
+        const auto secondSize = juce::jmin (numSamples - firstSize, writePos);
+
+        for (int ch = 0; ch < juce::jmin (numChannels, delayMemory.getNumChannels()); ++ch)
+        {
+            const auto* data = delayMemory.getReadPointer (ch);
+
+            includeDelayRange (data + writePos, firstSize);
+            includeDelayRange (data, secondSize);
+        }
+
+        finishBlock (numSamples);
+    }
+
+    /** Audio thread: a block that was skipped as silent */
+    void addSilence (int numSamples) noexcept
+    {
+        finishBlock (numSamples);
+    }
+
+    //==============================================================================
+    /** GUI thread: moves up to maxNumSummaries queued summaries into dest, oldest first */
+    int pop (MeterSummary* dest, int maxNumSummaries) noexcept
+    {
+        const auto scope = fifo.read (maxNumSummaries);
+
+        std::copy_n (summaries.begin() + scope.startIndex1, scope.blockSize1, dest);
+        std::copy_n (summaries.begin() + scope.startIndex2, scope.blockSize2, dest + scope.blockSize1);
+
+        return scope.blockSize1 + scope.blockSize2;
+    }
+
+private:
+    juce::AbstractFifo fifo { fifoSize };
+    std::array<MeterSummary, fifoSize> summaries;
+
+    // audio thread only
+    MeterSummary pending;
+    int samplesPerSummary = 1;
+    int numChannels = 0;
+
+    //==============================================================================
+    template <typename SampleType>
+    void measureLevels (const juce::AudioBuffer<SampleType>& buffer,
+                        std::array<float, MeterSummary::numChannels>& peak,
+                        std::array<float, MeterSummary::numChannels>& meanSquare) const noexcept
+    {
+        const auto numSamples = buffer.getNumSamples();
+        const auto available = juce::jmin (numChannels, buffer.getNumChannels());
+
+        if (available == 0 || numSamples == 0)
+            return;
+
+        for (int ch = 0; ch < MeterSummary::numChannels; ++ch)
+        {
+            const auto source = juce::jmin (ch, available - 1);
+            const auto rms = (float) buffer.getRMSLevel (source, 0, numSamples);
+
+            /* the mean over the summary is weighted by block length, so keep a sum until it's pushed */
+            peak[(size_t) ch] = juce::jmax (peak[(size_t) ch], (float) buffer.getMagnitude (source, 0, numSamples));
+            meanSquare[(size_t) ch] += rms * rms * (float) numSamples;
+        }
+    }
+
+    template <typename SampleType>
+    void includeDelayRange (const SampleType* data, int numSamples) noexcept
+    {
+        if (numSamples <= 0)
+            return;
+
+        const auto range = juce::FloatVectorOperations::findMinAndMax (data, numSamples);
+        pending.delayMin = juce::jmin (pending.delayMin, (float) range.getStart());
+        pending.delayMax = juce::jmax (pending.delayMax, (float) range.getEnd());
+    }
+
+    void finishBlock (int numSamples) noexcept
+    {
+        pending.numSamples += numSamples;
+
+        if (pending.numSamples < samplesPerSummary)
+            return;
+
+        for (auto* meanSquares : { &pending.inputMeanSquare, &pending.outputMeanSquare })
+            for (auto& value : *meanSquares)
+                value /= (float) pending.numSamples;
+
+        const auto scope = fifo.write (1);
+
+        if (scope.blockSize1 > 0)
+            summaries[(size_t) scope.startIndex1] = pending;
+        else if (scope.blockSize2 > 0)
+            summaries[(size_t) scope.startIndex2] = pending;
+
+        pending = {};
+    }
+
+    JUCE_DECLARE_NON_COPYABLE (MeterCollector)
+};
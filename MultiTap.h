@@ -0,0 +1,151 @@
+/*
+  ==============================================================================
+
+    MultiTap.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "Delay.h"
+
+//==============================================================================
+/** One read head of a tap pattern */
+struct DelayTap
+{
+    float delayMs;
+    float gain;
+    float pan;          // -1 (left) .. +1 (right)
+};
+
+/** Up to maxNumTaps taps, trivially copyable so it can go through a TripleBuffer */
+struct TapPattern
+{
+    static constexpr int maxNumTaps = 32;
+
+    std::array<DelayTap, maxNumTaps> taps {};
+    int numTaps = 0;
+};
+
+//==============================================================================
+/**
+    Reads every tap of a TapPattern out of a multichannel ring buffer that
+    has already been written for the block, and adds them to the output.
+
+    The taps sit on whole samples and have no ramps of their own: each tap
+    is one or two contiguous runs of the ring (see DelaySpans), accumulated
+    with FloatVectorOperations::addWithMultiply. The cost is
+    taps x channels x samples, with nothing else per sample.
+
+    Panning is equal-power. A channel's speaker position decides which half
+    of the pan law it takes; centre channels ignore the pan.
+*/
+class MultiTap
+{
+public:
+    static constexpr int maxNumChannels = 16;
+
+    //==============================================================================
+    void prepare (double newSampleRate, int newNumChannels, int newMaxDelaySamples)
+    {
+        jassert (newNumChannels <= maxNumChannels);
+
+        sampleRate = newSampleRate;
+        numChannels = juce::jmin (newNumChannels, maxNumChannels);
+        maxDelaySamples = newMaxDelaySamples;
+        positions.fill (0.0f);
+        numTaps = 0;
+    }
+
+    /** -1 for a left-hand speaker, +1 for a right-hand one, 0 for a centre one */
+    void setSpeakerPosition (int channel, float position) noexcept
+    {
+        jassert (juce::isPositiveAndBelow (channel, maxNumChannels));
+        positions[(size_t) channel] = position;
+    }
+
+    //==============================================================================
+    /** Converts a pattern to samples and per-channel gains. Doesn't allocate. */
+    void setPattern (const TapPattern& pattern) noexcept
+    {
+        numTaps = juce::jlimit (0, TapPattern::maxNumTaps, pattern.numTaps);
+
+        for (int t = 0; t < numTaps; ++t)
+        {
+            auto& tap = pattern.taps[(size_t) t];
+            delays[(size_t) t] = juce::jlimit (0, maxDelaySamples, juce::roundToInt (tap.delayMs * sampleRate / 1000.0));
+
+            const auto angle = (juce::jlimit (-1.0f, 1.0f, tap.pan) + 1.0f) * juce::MathConstants<float>::pi * 0.25f;
+
+            for (int ch = 0; ch < numChannels; ++ch)
+            {
+                const auto position = positions[(size_t) ch];
+                const auto panGain = position < 0.0f ? std::cos (angle)
+                                   : position > 0.0f ? std::sin (angle)
+                                                     : 1.0f;
+
+                gains[(size_t) ch][(size_t) t] = tap.gain * panGain;
+            }
+        }
+    }
+
+    bool isActive() const noexcept
+    {
+        return numTaps > 0;
+    }
+
+    //==============================================================================
+    /**
+        Adds the taps for the numSamples that start at writePos in delayBuffer,
+        whose length must be a power of two, to outputs (one per channel).
+        The ring must be at least numSamples longer than the longest tap.
+        SampleType is float or double, whichever the host processes in.
+    */
+    template <typename SampleType>
+    void process (const juce::AudioBuffer<SampleType>& delayBuffer, int writePos,
+                  SampleType* const* outputs, int numSamples) const noexcept
+    {
+        const auto ringSize = delayBuffer.getNumSamples();
+
+        /* the run must not have overwritten what the longest tap still reads */
+        jassert (juce::isPowerOfTwo (ringSize) && numSamples + maxDelaySamples <= ringSize);
+
+        for (int ch = 0; ch < juce::jmin (numChannels, delayBuffer.getNumChannels()); ++ch)
+            processChannel (ch, delayBuffer.getReadPointer (ch), ringSize, writePos, outputs[ch], numSamples);
+    }
+
+private:
+    double sampleRate = 44100.0;
+    int numChannels = 0;
+    int maxDelaySamples = 0;
+    int numTaps = 0;
+
+    std::array<int, TapPattern::maxNumTaps> delays {};
+    std::array<std::array<float, TapPattern::maxNumTaps>, maxNumChannels> gains {};   // [channel][tap]
+    std::array<float, maxNumChannels> positions {};
+
+    //==============================================================================
+    template <typename SampleType>
+    void processChannel (int ch, const SampleType* data, int ringSize, int writePos,
+                         SampleType* output, int numSamples) const noexcept
+    {
+        const auto mask = ringSize - 1;
+
+        for (int t = 0; t < numTaps; ++t)
+        {
+            const auto gain = (SampleType) gains[(size_t) ch][(size_t) t];
+
+            if (gain == SampleType (0))
+                continue;
+
+            const auto start = (size_t) ((writePos - delays[(size_t) t]) & mask);
+            const auto spans = DelaySpans<const SampleType>::fromRing (data, (size_t) ringSize, start, (size_t) numSamples);
+
+            juce::FloatVectorOperations::addWithMultiply (output, spans.first, gain, (int) spans.firstSize);
+
+            if (spans.secondSize > 0)
+                juce::FloatVectorOperations::addWithMultiply (output + spans.firstSize, spans.second, gain, (int) spans.secondSize);
+        }
+    }
+};
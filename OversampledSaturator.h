@@ -0,0 +1,97 @@
+/*
+  ==============================================================================
+
+    OversampledSaturator.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "Saturation.h"
+
+//==============================================================================
+/**
+    Runs a Saturator policy at 2, 4 or 8 times the sample rate, on one
+    channel, with juce::dsp::Oversampling around it: only the nonlinearity
+    pays for the higher rate, not the delay line or the host.
+
+    The half-band filters delay the signal by getLatencySamples(), a whole
+    number of samples: the oversampler is built with integer latency, which
+    pads out the IIR ones' fractional delay. Delay puts that latency inside
+    its feedback loop and takes it off the read head, so what comes out is
+    not delayed at all.
+
+    prepare() allocates, so call it from Delay::prepare(), never while
+    processing.
+*/
+template <typename Type, typename Saturator>
+class OversampledSaturator
+{
+public:
+    /** Polyphase IIR half-bands are cheaper; the FIR ones have linear phase */
+    enum class Filter { iir, fir };
+
+    //==============================================================================
+    /** factorLog2 is 1, 2 or 3 for 2x, 4x or 8x; 0 leaves the saturator at the base rate */
+    void prepare (size_t factorLog2, Filter filter, size_t maxBlockSize)
+    {
+        jassert (factorLog2 <= 3);
+
+        oversampling.reset();
+
+        if (factorLog2 == 0)
+            return;
+
+        const auto type = filter == Filter::iir ? juce::dsp::Oversampling<Type>::filterHalfBandPolyphaseIIR
+                                                : juce::dsp::Oversampling<Type>::filterHalfBandFIREquiripple;
+
+        // maximum quality, and integer latency
+        oversampling = std::make_unique<juce::dsp::Oversampling<Type>> (1, factorLog2, type, true, true);
+        oversampling->initProcessing (maxBlockSize);
+    }
+
+    void reset() noexcept
+    {
+        if (oversampling != nullptr)
+            oversampling->reset();
+    }
+
+    bool isEnabled() const noexcept
+    {
+        return oversampling != nullptr;
+    }
+
+    /** Base-rate samples between a sample going in and its saturated version coming out */
+    size_t getLatencySamples() const noexcept
+    {
+        return oversampling != nullptr ? (size_t) juce::roundToInt (oversampling->getLatencyInSamples()) : 0;
+    }
+
+    //==============================================================================
+    /** Saturates numSamples in place; at most the maxBlockSize given to prepare() */
+    void process (Type* samples, size_t numSamples) noexcept
+    {
+        if (oversampling == nullptr)
+        {
+            for (size_t i = 0; i < numSamples; ++i)
+                samples[i] = Saturator::process (samples[i]);
+
+            return;
+        }
+
+        Type* channels[] = { samples };
+        juce::dsp::AudioBlock<Type> block (channels, 1, numSamples);
+
+        auto upsampled = oversampling->processSamplesUp (block);
+        auto* data = upsampled.getChannelPointer (0);
+
+        for (size_t i = 0; i < upsampled.getNumSamples(); ++i)
+            data[i] = Saturator::process (data[i]);
+
+        oversampling->processSamplesDown (block);
+    }
+
+private:
+    std::unique_ptr<juce::dsp::Oversampling<Type>> oversampling;
+};
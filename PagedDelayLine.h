@@ -0,0 +1,388 @@
+/*
+  ==============================================================================
+
+    PagedDelayLine.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "Delay.h"
+
+//==============================================================================
+/**
+    Fixed-size pages of delay memory, shared by every PagedDelayLine of the
+    same sample type in the process.
+
+    allocate() and release() are lock-free (a free list with a tagged head,
+    so a page that is popped and pushed back in between can't confuse it),
+    which lets audio threads take and return pages. New pages are only ever
+    allocated by reserve() and by a background thread, never on an audio
+    thread. That thread sleeps until an allocate() leaves fewer than
+    lowWaterMark pages free, then tops the pool up.
+
+    Pages are left uninitialised: the operating system only commits the
+    memory behind a page once something is written to it.
+*/
+template <typename Type>
+class DelayPagePool  : private juce::Thread
+{
+public:
+    static constexpr size_t pageSize = 4096;        // samples
+    static constexpr int maxNumPages = 1 << 16;     // 1 GiB of float pages
+    static constexpr int lowWaterMark = 256;
+
+    DelayPagePool()
+        : juce::Thread ("Delay page pool"),
+          pages ((size_t) maxNumPages),
+          nextFree (new std::atomic<int>[(size_t) maxNumPages])
+    {
+        startThread();
+    }
+
+    ~DelayPagePool() override
+    {
+        stopThread (1000);
+    }
+
+    //==============================================================================
+    /**
+        Takes a free page; returns -1 if there is none. Lock-free, except that
+        the call which leaves lowWaterMark - 1 pages free signals the pool's
+        thread, which briefly takes the event's mutex.
+    */
+    int allocate() noexcept
+    {
+        auto head = freeHead.load (std::memory_order_acquire);
+
+        for (;;)
+        {
+            const auto index = getIndex (head);
+
+            if (index < 0)
+                return -1;
+
+            const auto newHead = makeHead (nextFree[index].load (std::memory_order_relaxed), head);
+
+            if (freeHead.compare_exchange_weak (head, newHead, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                // only the allocation that crosses the mark wakes the thread, so this is once per top-up
+                if (numFree.fetch_sub (1, std::memory_order_relaxed) == lowWaterMark)
+                    notify();
+
+                return index;
+            }
+        }
+    }
+
+    /** Gives a page back. Lock-free. */
+    void release (int index) noexcept
+    {
+        jassert (juce::isPositiveAndBelow (index, numAllocated.load()));
+        auto head = freeHead.load (std::memory_order_relaxed);
+
+        for (;;)
+        {
+            nextFree[index].store (getIndex (head), std::memory_order_relaxed);
+
+            if (freeHead.compare_exchange_weak (head, makeHead (index, head), std::memory_order_release, std::memory_order_relaxed))
+            {
+                numFree.fetch_add (1, std::memory_order_relaxed);
+                return;
+            }
+        }
+    }
+
+    Type* getPage (int index) const noexcept
+    {
+        return pages[(size_t) index].get();
+    }
+
+    //==============================================================================
+    /** Allocates pages until at least numPages are free, or the pool is full. Not for the audio thread. */
+    void reserve (int numPages)
+    {
+        const juce::ScopedLock sl (growLock);
+
+        while (numFree.load() < numPages && numAllocated.load() < maxNumPages)
+        {
+            const auto index = numAllocated.load();
+            pages[(size_t) index].reset (new Type[pageSize]);
+            numAllocated.store (index + 1);
+            release (index);
+        }
+    }
+
+    int getNumFreePages() const noexcept
+    {
+        return numFree.load (std::memory_order_relaxed);
+    }
+
+private:
+    std::vector<std::unique_ptr<Type[]>> pages;
+    std::unique_ptr<std::atomic<int>[]> nextFree;
+
+    /* index + 1 in the low 32 bits (0 for an empty list), a change counter in the high ones */
+    std::atomic<juce::uint64> freeHead { 0 };
+    std::atomic<int> numFree { 0 }, numAllocated { 0 };
+    juce::CriticalSection growLock;
+
+    static int getIndex (juce::uint64 head) noexcept
+    {
+        return (int) (head & 0xffffffffu) - 1;
+    }
+
+    static juce::uint64 makeHead (int index, juce::uint64 previous) noexcept
+    {
+        return (((previous >> 32) + 1) << 32) | (juce::uint64) (index + 1);
+    }
+
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            if (getNumFreePages() < lowWaterMark)
+                reserve (2 * lowWaterMark);
+
+            wait (-1);
+        }
+    }
+
+    JUCE_DECLARE_NON_COPYABLE (DelayPagePool)
+};
+
+//==============================================================================
+/**
+    A drop-in for DelayLine (see Delay's Storage parameter) for delays of
+    minutes: the ring is a table of page slots, and a slot only takes a
+    page from the shared DelayPagePool when the write head first enters it.
+    Until then it reads back as silence, so resize() costs a slot table and
+    a line only holds as much memory as it has written.
+
+    If the pool has no free page when the write head enters a slot, that
+    slot stays silent until the head comes round again. Its samples are
+    written to a scratch page and dropped.
+
+    Spans are at most maxSpanSize samples long, so they touch at most two
+    pages and still fit in DelaySpans.
+
+    Only Delay can use it. The plugin processor keeps one contiguous buffer,
+    which its taps and meters read directly, as its time parameters stop at
+    2 s.
+*/
+template <typename Type>
+class PagedDelayLine
+{
+public:
+    using Pool = DelayPagePool<Type>;
+
+    static constexpr size_t pageSize = Pool::pageSize;
+    static constexpr size_t maxSpanSize = pageSize;
+
+    PagedDelayLine() = default;
+
+    ~PagedDelayLine()
+    {
+        releasePages();
+    }
+
+    //==============================================================================
+    /** Gives every page back to the pool, which also silences the line */
+    void clear() noexcept
+    {
+        releasePages();
+        writeCount = 0;
+    }
+
+    size_t size() const noexcept
+    {
+        return maxDelay;
+    }
+
+    size_t capacity() const noexcept
+    {
+        return slots.size() * pageSize;
+    }
+
+    void resize (size_t newValue)
+    {
+        releasePages();
+
+        maxDelay = newValue;
+
+        /*
+            two spare slots, so neither the slot being written nor the next
+            one can still be read from the previous lap: a slot that missed
+            its page on that lap and gets one now must never be read before
+            it is written
+        */
+        const auto numSlots = (size_t) juce::nextPowerOfTwo ((int) ((newValue + pageSize - 1) / pageSize + 2));
+
+        slots.assign (numSlots, {});
+        slotMask = numSlots - 1;
+        scratchPage.assign (pageSize, Type (0));
+        writeCount = 0;
+
+        for (auto& slot : slots)
+            slot.write = scratchPage.data();
+
+        pool->reserve (Pool::lowWaterMark);
+    }
+
+    //==============================================================================
+    Type back() const noexcept
+    {
+        return get (size() - 1);
+    }
+
+    Type get (size_t delayInSamples) const noexcept
+    {
+        jassert (delayInSamples < size());
+
+        const auto position = (juce::int64) writeCount - 1 - (juce::int64) delayInSamples;
+        return position < 0 ? Type (0) : slotFor (position).read[position & pageMask];
+    }
+
+    void set (size_t delayInSamples, Type newValue) noexcept
+    {
+        jassert (delayInSamples < size());
+
+        const auto position = (juce::int64) writeCount - 1 - (juce::int64) delayInSamples;
+
+        if (position >= 0 && slotFor (position).page >= 0)
+            slotFor (position).write[position & pageMask] = newValue;
+    }
+
+    void push (Type valueToAdd) noexcept
+    {
+        const auto position = (juce::int64) writeCount;
+
+        if ((position & pageMask) == 0)
+            commit (slotFor (position));
+
+        slotFor (position).write[position & pageMask] = valueToAdd;
+        ++writeCount;
+    }
+
+    //==============================================================================
+    DelaySpans<Type> getWriteSpans (size_t numSamples) noexcept
+    {
+        jassert (numSamples <= maxSpanSize);
+
+        const auto position = (juce::int64) writeCount;
+        const auto offset = (size_t) (position & pageMask);
+        const auto firstSize = juce::jmin (numSamples, pageSize - offset);
+
+        if (offset == 0)
+            commit (slotFor (position));
+
+        if (firstSize == numSamples)
+            return { slotFor (position).write + offset, firstSize, nullptr, 0 };
+
+        auto& next = slotFor (position + (juce::int64) firstSize);
+        commit (next);
+
+        return { slotFor (position).write + offset, firstSize, next.write, numSamples - firstSize };
+    }
+
+    DelaySpans<const Type> getReadSpans (size_t delayInSamples, size_t numSamples) const noexcept
+    {
+        jassert (delayInSamples < size() && numSamples <= delayInSamples + 1);
+        jassert (numSamples <= maxSpanSize);
+
+        const auto position = (juce::int64) writeCount - 1 - (juce::int64) delayInSamples;
+
+        size_t firstSize, secondSize;
+        auto* first = readRun (position, numSamples, firstSize);
+
+        if (firstSize == numSamples)
+            return { first, firstSize, nullptr, 0 };
+
+        auto* second = readRun (position + (juce::int64) firstSize, numSamples - firstSize, secondSize);
+        jassert (firstSize + secondSize == numSamples);
+
+        return { first, firstSize, second, secondSize };
+    }
+
+    void advance (size_t numSamples) noexcept
+    {
+        writeCount += numSamples;
+    }
+
+private:
+    //==============================================================================
+    struct Slot
+    {
+        const Type* read = getSilence();    // the page, or silence before it was committed
+        Type* write = nullptr;              // the page, or the scratch page
+        int page = -1;
+    };
+
+    static constexpr juce::int64 pageMask = (juce::int64) pageSize - 1;
+
+    juce::SharedResourcePointer<Pool> pool;
+    std::vector<Slot> slots;
+    std::vector<Type> scratchPage;
+    size_t slotMask = 0, maxDelay = 0;
+    size_t writeCount = 0;
+
+    static const Type* getSilence() noexcept
+    {
+        static const std::vector<Type> silence (pageSize, Type (0));
+        return silence.data();
+    }
+
+    Slot& slotFor (juce::int64 position) noexcept
+    {
+        return slots[(size_t) (position / (juce::int64) pageSize) & slotMask];
+    }
+
+    const Slot& slotFor (juce::int64 position) const noexcept
+    {
+        return slots[(size_t) (position / (juce::int64) pageSize) & slotMask];
+    }
+
+    /* a slot takes its page on entry only, so a committed page never holds unwritten samples that get read */
+    void commit (Slot& slot) noexcept
+    {
+        if (slot.page >= 0)
+            return;
+
+        const auto page = pool->allocate();
+
+        if (page < 0)
+            return;
+
+        slot.page = page;
+        slot.write = pool->getPage (page);
+        slot.read = slot.write;
+    }
+
+    const Type* readRun (juce::int64 position, size_t maxLength, size_t& length) const noexcept
+    {
+        if (position < 0)
+        {
+            length = (size_t) juce::jmin ((juce::int64) maxLength, -position);
+            return getSilence();
+        }
+
+        const auto offset = (size_t) (position & pageMask);
+        length = juce::jmin (maxLength, pageSize - offset);
+        return slotFor (position).read + offset;
+    }
+
+    void releasePages() noexcept
+    {
+        for (auto& slot : slots)
+        {
+            if (slot.page >= 0)
+                pool->release (slot.page);
+
+            slot = {};
+            slot.write = scratchPage.data();
+        }
+    }
+
+    JUCE_DECLARE_NON_COPYABLE (PagedDelayLine)
+};
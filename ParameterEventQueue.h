@@ -0,0 +1,79 @@
+/*
+  ==============================================================================
+
+    ParameterEventQueue.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+//==============================================================================
+/** A parameter change that should take effect at a given sample */
+struct ParameterEvent
+{
+    juce::int64 samplePosition;     // counted from the last prepareToPlay
+    int parameterIndex;
+    float value;                    // plain (unnormalised) value
+};
+
+//==============================================================================
+/**
+    Fixed-size single-producer, single-consumer queue of ParameterEvents.
+    Nothing allocates after construction, so the audio thread can drain it.
+
+    Events must be pushed in order of samplePosition.
+*/
+class ParameterEventQueue
+{
+public:
+    explicit ParameterEventQueue (int capacity = 1024)
+        : fifo (capacity), events ((size_t) capacity)
+    {
+    }
+
+    //==============================================================================
+    /** Producer side: returns false, dropping the event, if the queue is full */
+    bool push (const ParameterEvent& event) noexcept
+    {
+        const auto scope = fifo.write (1);
+
+        if (scope.blockSize1 + scope.blockSize2 == 0)
+            return false;
+
+        events[(size_t) (scope.blockSize1 > 0 ? scope.startIndex1 : scope.startIndex2)] = event;
+        return true;
+    }
+
+    //==============================================================================
+    /** Consumer side: the oldest event without removing it */
+    bool peek (ParameterEvent& event) const noexcept
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToRead (1, start1, size1, start2, size2);
+
+        if (size1 + size2 == 0)
+            return false;
+
+        event = events[(size_t) (size1 > 0 ? start1 : start2)];
+        return true;
+    }
+
+    /** Consumer side: removes the oldest event */
+    void pop() noexcept
+    {
+        fifo.finishedRead (1);
+    }
+
+    /** Consumer side: drops every event queued so far */
+    void clear() noexcept
+    {
+        fifo.finishedRead (fifo.getNumReady());
+    }
+
+private:
+    juce::AbstractFifo fifo;
+    std::vector<ParameterEvent> events;
+
+    JUCE_DECLARE_NON_COPYABLE (ParameterEventQueue)
+};
@@ -54,6 +54,15 @@ VariDelayAudioProcessorEditor::VariDelayAudioProcessorEditor (VariDelayAudioProc
     wetLabel->attachToComponent (wetSlider.get(), false);
     wetLabel->setJustificationType (Justification::centred);
     
+    loadLabel = std::make_unique<Label>("", "DSP load");
+    loadLabel->setBounds (100, 420, 300, 24);
+    loadLabel->setJustificationType (Justification::centred);
+    addAndMakeVisible (loadLabel.get());
+    
+    meterDisplay = std::make_unique<MeterDisplay> (audioProcessor);
+    meterDisplay->setBounds (50, 460, 400, 110);
+    addAndMakeVisible (meterDisplay.get());
+    
     using Attachment = juce::AudioProcessorValueTreeState::SliderAttachment;
     delayAttachmentL = std::make_unique<Attachment>(audioProcessor.apvts, "Time L", *delaySliderL);
     delayAttachmentR = std::make_unique<Attachment>(audioProcessor.apvts, "Time R", *delaySliderR);
@@ -69,13 +78,33 @@ VariDelayAudioProcessorEditor::VariDelayAudioProcessorEditor (VariDelayAudioProc
 
     sendLookAndFeelChange();
     
-    setSize (500, 500);
+    setSize (500, 600);
+    
+    timingCursor = audioProcessor.getBlockTimings().getNumPushed();
+    startTimerHz (timerHz);
 }
 
 VariDelayAudioProcessorEditor::~VariDelayAudioProcessorEditor()
 {
 }
 
+/* shows the mean and p99 load of the blocks processed over the last couple of seconds */
+void VariDelayAudioProcessorEditor::timerCallback()
+{
+    audioProcessor.getBlockTimings().read (timingCursor, [this] (const BlockTiming& timing) { loadStatistics.add (timing); });
+    
+    if (++numLoadTicks < loadWindowTicks)
+        return;
+    
+    if (loadStatistics.getNumBlocks() > 0)
+        loadLabel->setText ("DSP load " + String (100.0f * loadStatistics.getMeanLoad(), 1)
+                            + "%, p99 " + String (100.0f * loadStatistics.getLoadPercentile (0.99), 1) + "%",
+                            dontSendNotification);
+    
+    loadStatistics.reset();
+    numLoadTicks = 0;
+}
+
 //==============================================================================
 void VariDelayAudioProcessorEditor::paint (juce::Graphics& g)
 {
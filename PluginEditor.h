@@ -11,11 +11,13 @@
 #include <JuceHeader.h>
 #include "PluginProcessor.h"
 #include "LookAndFeel.h"
+#include "MeterDisplay.h"
 
 //==============================================================================
 /**
 */
-class VariDelayAudioProcessorEditor  : public AudioProcessorEditor
+class VariDelayAudioProcessorEditor  : public AudioProcessorEditor,
+                                       private Timer
 {
 public:
     VariDelayAudioProcessorEditor (VariDelayAudioProcessor&);
@@ -40,6 +42,18 @@ private:
     std::unique_ptr<Label> fbLabelL;
     std::unique_ptr<Label> fbLabelR;
     std::unique_ptr<Label> wetLabel;
+    std::unique_ptr<Label> loadLabel;
+    
+    std::unique_ptr<MeterDisplay> meterDisplay;
+    
+    // the DSP load readout, refreshed from the processor's block timings every loadWindowTicks timer calls
+    static constexpr int timerHz = 10;
+    static constexpr int loadWindowTicks = 20;
+    int64 timingCursor = 0;
+    BlockLoadStatistics loadStatistics;
+    int numLoadTicks = 0;
+    
+    void timerCallback() override;
     
     using Attachment = juce::AudioProcessorValueTreeState::SliderAttachment;
     std::unique_ptr<Attachment> delayAttachmentL;
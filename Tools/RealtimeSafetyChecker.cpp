@@ -0,0 +1,260 @@
+/*
+  ==============================================================================
+
+    RealtimeSafetyChecker.cpp
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "RealtimeSafetyChecker.h"
+
+#include <new>
+
+#if JUCE_LINUX
+ #include <dlfcn.h>
+ #include <pthread.h>
+
+extern "C"
+{
+    void* __libc_malloc (size_t);
+    void* __libc_calloc (size_t, size_t);
+    void* __libc_realloc (void*, size_t);
+    void  __libc_free (void*);
+}
+#endif
+
+namespace RealtimeSafetyChecker
+{
+    namespace
+    {
+        thread_local bool isAudioThread = false;
+
+        std::atomic<juce::int64> counts[numViolations] {};
+        std::atomic<bool> hasBacktrace { false };
+        juce::String firstBacktrace;
+    }
+
+    /* the backtrace allocates, so the thread stops counting while it takes it */
+    static void report (Violation violation) noexcept
+    {
+        if (! isAudioThread)
+            return;
+
+        counts[(int) violation].fetch_add (1, std::memory_order_relaxed);
+
+        if (! hasBacktrace.exchange (true))
+        {
+            isAudioThread = false;
+            firstBacktrace = juce::String (getName (violation)) + " inside processBlock:\n" + juce::SystemStats::getStackBacktrace();
+            isAudioThread = true;
+        }
+    }
+
+    const char* getName (Violation violation) noexcept
+    {
+        switch (violation)
+        {
+            case Violation::allocation:   return "allocation";
+            case Violation::deallocation: return "deallocation";
+            case Violation::lock:         return "lock";
+            default:                      return "";
+        }
+    }
+
+    ScopedAudioThread::ScopedAudioThread() noexcept   { isAudioThread = true; }
+    ScopedAudioThread::~ScopedAudioThread() noexcept  { isAudioThread = false; }
+
+    juce::int64 getCount (Violation violation) noexcept
+    {
+        return counts[(int) violation].load (std::memory_order_relaxed);
+    }
+
+    juce::String getFirstBacktrace()
+    {
+        return hasBacktrace.load() ? firstBacktrace : juce::String();
+    }
+
+    void resetCounts() noexcept
+    {
+        for (auto& count : counts)
+            count = 0;
+
+        hasBacktrace = false;
+    }
+
+    bool canDetectMallocAndLocks() noexcept
+    {
+       #if JUCE_LINUX
+        return true;
+       #else
+        return false;
+       #endif
+    }
+
+    //==============================================================================
+    /* the allocator underneath the hooks, which never reports */
+    static void* rawAllocate (size_t size) noexcept
+    {
+       #if JUCE_LINUX
+        return __libc_malloc (size);
+       #else
+        return std::malloc (size);
+       #endif
+    }
+
+    static void rawFree (void* pointer) noexcept
+    {
+       #if JUCE_LINUX
+        __libc_free (pointer);
+       #else
+        std::free (pointer);
+       #endif
+    }
+
+    static void* rawAllocateAligned (size_t size, size_t alignment) noexcept
+    {
+       #if JUCE_WINDOWS
+        return _aligned_malloc (size, alignment);
+       #else
+        void* pointer = nullptr;
+        return posix_memalign (&pointer, juce::jmax (alignment, sizeof (void*)), size) == 0 ? pointer : nullptr;
+       #endif
+    }
+
+    static void rawFreeAligned (void* pointer) noexcept
+    {
+       #if JUCE_WINDOWS
+        _aligned_free (pointer);
+       #else
+        rawFree (pointer);
+       #endif
+    }
+}
+
+//==============================================================================
+/* the replaceable global allocation functions, every form of them */
+namespace
+{
+    using namespace RealtimeSafetyChecker;
+
+    void* checkedNew (size_t size)
+    {
+        report (Violation::allocation);
+
+        if (auto* pointer = rawAllocate (size == 0 ? 1 : size))
+            return pointer;
+
+        throw std::bad_alloc();
+    }
+
+    void* checkedNewAligned (size_t size, std::align_val_t alignment)
+    {
+        report (Violation::allocation);
+
+        if (auto* pointer = rawAllocateAligned (size == 0 ? 1 : size, (size_t) alignment))
+            return pointer;
+
+        throw std::bad_alloc();
+    }
+
+    void checkedDelete (void* pointer) noexcept
+    {
+        if (pointer != nullptr)
+        {
+            report (Violation::deallocation);
+            rawFree (pointer);
+        }
+    }
+
+    void checkedDeleteAligned (void* pointer) noexcept
+    {
+        if (pointer != nullptr)
+        {
+            report (Violation::deallocation);
+            rawFreeAligned (pointer);
+        }
+    }
+}
+
+void* operator new   (size_t size)                                          { return checkedNew (size); }
+void* operator new[] (size_t size)                                          { return checkedNew (size); }
+void* operator new   (size_t size, const std::nothrow_t&) noexcept          { try { return checkedNew (size); } catch (...) { return nullptr; } }
+void* operator new[] (size_t size, const std::nothrow_t&) noexcept          { try { return checkedNew (size); } catch (...) { return nullptr; } }
+void* operator new   (size_t size, std::align_val_t alignment)              { return checkedNewAligned (size, alignment); }
+void* operator new[] (size_t size, std::align_val_t alignment)              { return checkedNewAligned (size, alignment); }
+void* operator new   (size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept  { try { return checkedNewAligned (size, alignment); } catch (...) { return nullptr; } }
+void* operator new[] (size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept  { try { return checkedNewAligned (size, alignment); } catch (...) { return nullptr; } }
+
+void operator delete   (void* pointer) noexcept                                         { checkedDelete (pointer); }
+void operator delete[] (void* pointer) noexcept                                         { checkedDelete (pointer); }
+void operator delete   (void* pointer, size_t) noexcept                                 { checkedDelete (pointer); }
+void operator delete[] (void* pointer, size_t) noexcept                                 { checkedDelete (pointer); }
+void operator delete   (void* pointer, const std::nothrow_t&) noexcept                  { checkedDelete (pointer); }
+void operator delete[] (void* pointer, const std::nothrow_t&) noexcept                  { checkedDelete (pointer); }
+void operator delete   (void* pointer, std::align_val_t) noexcept                       { checkedDeleteAligned (pointer); }
+void operator delete[] (void* pointer, std::align_val_t) noexcept                       { checkedDeleteAligned (pointer); }
+void operator delete   (void* pointer, size_t, std::align_val_t) noexcept               { checkedDeleteAligned (pointer); }
+void operator delete[] (void* pointer, size_t, std::align_val_t) noexcept               { checkedDeleteAligned (pointer); }
+void operator delete   (void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { checkedDeleteAligned (pointer); }
+void operator delete[] (void* pointer, std::align_val_t, const std::nothrow_t&) noexcept { checkedDeleteAligned (pointer); }
+
+//==============================================================================
+/*
+    On Linux the executable's own definitions of these win over glibc's, for
+    every library in the process. malloc and friends forward to glibc's
+    __libc_ entry points; pthread_mutex_lock has no such alias to link
+    against, so it's looked up behind us with dlsym, which takes its own
+    locks without going through this one.
+*/
+#if JUCE_LINUX
+extern "C"
+{
+    void* malloc (size_t size)
+    {
+        RealtimeSafetyChecker::report (RealtimeSafetyChecker::Violation::allocation);
+        return __libc_malloc (size);
+    }
+
+    void* calloc (size_t count, size_t size)
+    {
+        RealtimeSafetyChecker::report (RealtimeSafetyChecker::Violation::allocation);
+        return __libc_calloc (count, size);
+    }
+
+    void* realloc (void* pointer, size_t size)
+    {
+        RealtimeSafetyChecker::report (RealtimeSafetyChecker::Violation::allocation);
+        return __libc_realloc (pointer, size);
+    }
+
+    void free (void* pointer)
+    {
+        if (pointer != nullptr)
+            RealtimeSafetyChecker::report (RealtimeSafetyChecker::Violation::deallocation);
+
+        __libc_free (pointer);
+    }
+
+    int pthread_mutex_lock (pthread_mutex_t* mutex)
+    {
+        /*
+            constant-initialised, so it has no guard: a static with a dynamic
+            initialiser would take the guard's lock, which could end up in here again
+        */
+        using LockFunction = int (*) (pthread_mutex_t*);
+        static std::atomic<LockFunction> next { nullptr };
+
+        auto lock = next.load (std::memory_order_acquire);
+
+        if (lock == nullptr)
+        {
+            lock = (LockFunction) dlsym (RTLD_NEXT, "pthread_mutex_lock");
+            next.store (lock, std::memory_order_release);
+        }
+
+        RealtimeSafetyChecker::report (RealtimeSafetyChecker::Violation::lock);
+        return lock (mutex);
+    }
+}
+#endif
@@ -0,0 +1,57 @@
+/*
+  ==============================================================================
+
+    RealtimeSafetyChecker.h
+
+    Catches heap and lock calls made while a thread is marked as an audio
+    thread. Linking RealtimeSafetyChecker.cpp into a program replaces the
+    global operator new and delete and, on Linux, interposes malloc, free
+    and pthread_mutex_lock, so calls from JUCE and the standard library are
+    caught too, not only the ones in our own code.
+
+    Outside a ScopedAudioThread the hooks only forward, so the rest of the
+    program runs as usual.
+
+    Waits that never reach the OS, such as juce::SpinLock spinning on an
+    atomic, are invisible to it: code that could spin on another thread
+    still needs reading with that in mind.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+namespace RealtimeSafetyChecker
+{
+    enum class Violation
+    {
+        allocation,
+        deallocation,
+        lock
+    };
+
+    constexpr int numViolations = 3;
+
+    const char* getName (Violation violation) noexcept;
+
+    //==============================================================================
+    /** Counts every heap or lock call on this thread as a violation while it exists */
+    struct ScopedAudioThread
+    {
+        ScopedAudioThread() noexcept;
+        ~ScopedAudioThread() noexcept;
+
+        JUCE_DECLARE_NON_COPYABLE (ScopedAudioThread)
+    };
+
+    /** Violations seen so far, on any thread */
+    juce::int64 getCount (Violation violation) noexcept;
+
+    /** The stack at the first violation since resetCounts(), or an empty string */
+    juce::String getFirstBacktrace();
+
+    void resetCounts() noexcept;
+
+    /** False where only operator new and delete can be hooked */
+    bool canDetectMallocAndLocks() noexcept;
+}
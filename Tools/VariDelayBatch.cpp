@@ -0,0 +1,446 @@
+/*
+  ==============================================================================
+
+    VariDelayBatch.cpp
+
+    Offline batch renderer: runs every audio file in a folder (a stem each)
+    through its own VariDelayAudioProcessor, on all cores at once, and
+    reports the aggregate throughput.
+
+    VariDelayBatch --in-dir stems [--out-dir wet] [--threads 64] [--block 512]
+                   [--tail 2.0] [--bits 24] [--repeat 1] [--set "Time L=350"] ...
+
+    Each worker thread owns one processor, one set of audio buffers and its
+    own AudioFormatManager, all made before the rendering starts, so the
+    workers share nothing they write to. For every stem a worker opens a new
+    reader and calls prepareToPlay again: that is what clears the delay
+    memory, so no tail carries over from the stem before, and it picks up
+    the stem's sample rate (the delay memory is only reallocated when that
+    changes). A stem is one task: the delay carries state from one block to
+    the next, so a stem cannot be split between threads.
+
+    The stems are dealt out to the workers' queues up front. A worker takes
+    its own stems from the back of its queue, longest first, and when it
+    runs out it steals from the front of another worker's queue, where the
+    shortest ones are, so the cores finish together.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../PluginProcessor.h"
+
+#include <deque>
+#include <iostream>
+#include <thread>
+
+namespace
+{
+    struct BatchSettings
+    {
+        File inputFolder, outputFolder;
+        int numThreads = 0;         // 0 -> one per CPU
+        int blockSize = 512;
+        double tailSeconds = 2.0;
+        int bitDepth = 24;
+        int repeat = 1;             // renders the folder this many times, for timing small sets
+        StringPairArray parameters; // parameter ID -> plain (unnormalised) value
+    };
+
+    struct Stem
+    {
+        File file;
+        File output;                // none without --out-dir
+        int64 fileSize = 0;         // stands in for the length when dealing the stems out
+    };
+
+    void printUsage()
+    {
+        std::cout << "usage: VariDelayBatch --in-dir <folder> [--out-dir <folder>] [--threads <n>]\n"
+                     "                      [--block <samples>] [--tail <seconds>] [--bits <16|24|32>]\n"
+                     "                      [--repeat <n>] [--set \"<parameter id>=<value>\"] ...\n\n"
+                     "parameters: \"Time L\", \"Time R\" (ms), \"FB L\", \"FB R\" (dB), \"WET\" (0..1)\n";
+    }
+
+    bool parseSettings (const ArgumentList& args, BatchSettings& settings)
+    {
+        if (! args.containsOption ("--in-dir"))
+            return false;
+
+        settings.inputFolder = args.getExistingFolderForOption ("--in-dir");
+
+        if (args.containsOption ("--out-dir"))
+            settings.outputFolder = args.getFileForOption ("--out-dir");
+
+        if (args.containsOption ("--threads"))
+            settings.numThreads = args.getValueForOption ("--threads").getIntValue();
+
+        if (args.containsOption ("--block"))
+            settings.blockSize = args.getValueForOption ("--block").getIntValue();
+
+        if (args.containsOption ("--tail"))
+            settings.tailSeconds = args.getValueForOption ("--tail").getDoubleValue();
+
+        if (args.containsOption ("--bits"))
+            settings.bitDepth = args.getValueForOption ("--bits").getIntValue();
+
+        if (args.containsOption ("--repeat"))
+            settings.repeat = args.getValueForOption ("--repeat").getIntValue();
+
+        /* --set may be repeated, so walk the raw argument list instead of using getValueForOption */
+        for (int i = 0; i < args.size() - 1; ++i)
+        {
+            if (args[i].text != "--set")
+                continue;
+
+            auto assignment = args[i + 1].text;
+
+            if (! assignment.containsChar ('='))
+                ConsoleApplication::fail ("--set expects \"<parameter id>=<value>\", got: " + assignment);
+
+            settings.parameters.set (assignment.upToFirstOccurrenceOf ("=", false, false).trim(),
+                                     assignment.fromFirstOccurrenceOf ("=", false, false).trim());
+        }
+
+        if (settings.numThreads <= 0)
+            settings.numThreads = SystemStats::getNumCpus();
+
+        if (settings.blockSize <= 0 || settings.repeat <= 0)
+            ConsoleApplication::fail ("--block and --repeat must be positive");
+
+        if (settings.tailSeconds < 0)
+            ConsoleApplication::fail ("--tail must not be negative");
+
+        return true;
+    }
+
+    void applyParameters (VariDelayAudioProcessor& processor, const StringPairArray& parameters)
+    {
+        for (auto& id : parameters.getAllKeys())
+        {
+            auto* parameter = processor.apvts.getParameter (id);
+
+            if (parameter == nullptr)
+                ConsoleApplication::fail ("unknown parameter: " + id);
+
+            auto value = parameters[id].getFloatValue();
+            parameter->setValueNotifyingHost (parameter->convertTo0to1 (value));
+        }
+    }
+
+    //==============================================================================
+    /**
+        One thread's share of the batch. Everything in here is touched only by
+        its own thread while the batch runs, apart from the queue, which other
+        workers steal from under the lock.
+    */
+    struct Worker
+    {
+        explicit Worker (const BatchSettings& settings)
+        {
+            formats.registerBasicFormats();
+            applyParameters (processor, settings.parameters);
+            processor.setNonRealtime (true);
+
+            numChannels = jmax (processor.getTotalNumInputChannels(), processor.getTotalNumOutputChannels());
+            buffer.setSize (numChannels, settings.blockSize);
+        }
+
+        VariDelayAudioProcessor processor;
+        AudioFormatManager formats;
+        AudioBuffer<float> buffer;
+        MidiBuffer midi;
+        int numChannels = 0;
+
+        CriticalSection queueLock;
+        std::deque<size_t> queue;   // indices into the stem list
+
+        // results, read once every thread has finished
+        int numStems = 0, numStolen = 0;
+        int64 numSamples = 0;
+        double audioSeconds = 0;
+        int64 busyTicks = 0;
+        StringArray errors;
+    };
+
+    //==============================================================================
+    class BatchRenderer
+    {
+    public:
+        BatchRenderer (const BatchSettings& s, std::vector<Stem> stemsToRender)
+            : settings (s), stems (std::move (stemsToRender))
+        {
+            for (int i = 0; i < settings.numThreads; ++i)
+                workers.push_back (std::make_unique<Worker> (settings));
+
+            /* deal shortest first, so each queue has its longest stems at the back where its owner pops */
+            std::vector<size_t> order (stems.size());
+
+            for (size_t i = 0; i < order.size(); ++i)
+                order[i] = i;
+
+            std::stable_sort (order.begin(), order.end(),
+                              [this] (size_t a, size_t b) { return stems[a].fileSize < stems[b].fileSize; });
+
+            for (size_t i = 0; i < order.size(); ++i)
+                workers[i % workers.size()]->queue.push_back (order[i]);
+        }
+
+        /** Renders every stem and returns the wall-clock time it took */
+        double run()
+        {
+            const auto start = Time::getHighResolutionTicks();
+
+            std::vector<std::thread> threads;
+
+            for (size_t i = 0; i < workers.size(); ++i)
+                threads.emplace_back ([this, i] { runWorker (i); });
+
+            for (auto& thread : threads)
+                thread.join();
+
+            return Time::highResolutionTicksToSeconds (Time::getHighResolutionTicks() - start);
+        }
+
+        const std::vector<std::unique_ptr<Worker>>& getWorkers() const noexcept
+        {
+            return workers;
+        }
+
+    private:
+        const BatchSettings& settings;
+        const std::vector<Stem> stems;
+        std::vector<std::unique_ptr<Worker>> workers;
+
+        //==============================================================================
+        void runWorker (size_t index)
+        {
+            auto& worker = *workers[index];
+            size_t stem = 0;
+
+            /* no tasks are added once the batch runs, so one empty round of every queue means it's done */
+            while (popOwn (worker, stem) || steal (index, stem))
+                renderStem (worker, stems[stem]);
+        }
+
+        static bool popOwn (Worker& worker, size_t& stem)
+        {
+            const ScopedLock sl (worker.queueLock);
+
+            if (worker.queue.empty())
+                return false;
+
+            stem = worker.queue.back();
+            worker.queue.pop_back();
+            return true;
+        }
+
+        bool steal (size_t thiefIndex, size_t& stem)
+        {
+            const auto numWorkers = workers.size();
+
+            for (size_t offset = 1; offset < numWorkers; ++offset)
+            {
+                auto& victim = *workers[(thiefIndex + offset) % numWorkers];
+                const ScopedLock sl (victim.queueLock);
+
+                if (! victim.queue.empty())
+                {
+                    stem = victim.queue.front();
+                    victim.queue.pop_front();
+                    ++workers[thiefIndex]->numStolen;
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        //==============================================================================
+        void renderStem (Worker& worker, const Stem& stem)
+        {
+            std::unique_ptr<AudioFormatReader> reader (worker.formats.createReaderFor (stem.file));
+
+            if (reader == nullptr)
+            {
+                worker.errors.add ("cannot read " + stem.file.getFullPathName());
+                return;
+            }
+
+            const auto sampleRate = reader->sampleRate;
+            const auto blockSize  = settings.blockSize;
+
+            auto& processor = worker.processor;
+            processor.setRateAndBufferSizeDetails (sampleRate, blockSize);
+            processor.prepareToPlay (sampleRate, blockSize);
+
+            std::unique_ptr<AudioFormatWriter> writer;
+
+            if (stem.output != File())
+            {
+                writer = createWriter (stem.output, sampleRate, processor.getTotalNumOutputChannels());
+
+                if (writer == nullptr)
+                {
+                    worker.errors.add ("cannot write the output for " + stem.file.getFullPathName());
+                    return;
+                }
+            }
+
+            const auto inputLength = reader->lengthInSamples;
+            const auto totalLength = inputLength + (int64) std::ceil (settings.tailSeconds * sampleRate);
+            auto& buffer = worker.buffer;
+            int64 processTicks = 0;
+
+            for (int64 position = 0; position < totalLength; position += blockSize)
+            {
+                const auto numSamples = (int) jmin ((int64) blockSize, totalLength - position);
+                buffer.setSize (worker.numChannels, numSamples, false, false, true);
+
+                /* a mono file goes to both channels, and past its end the reader fills in silence */
+                if (position < inputLength)
+                    reader->read (&buffer, 0, numSamples, position, true, true);
+                else
+                    buffer.clear();
+
+                const auto start = Time::getHighResolutionTicks();
+                processor.processBlock (buffer, worker.midi);
+                processTicks += Time::getHighResolutionTicks() - start;
+
+                if (writer != nullptr)
+                    writer->writeFromAudioSampleBuffer (buffer, 0, numSamples);
+            }
+
+            processor.releaseResources();
+
+            ++worker.numStems;
+            worker.numSamples += totalLength;
+            worker.audioSeconds += (double) totalLength / sampleRate;
+            worker.busyTicks += processTicks;
+        }
+
+        std::unique_ptr<AudioFormatWriter> createWriter (const File& file, double sampleRate, int numChannels) const
+        {
+            file.deleteFile();
+            auto stream = file.createOutputStream();
+
+            if (stream == nullptr)
+                return {};
+
+            WavAudioFormat wav;
+            std::unique_ptr<AudioFormatWriter> writer (wav.createWriterFor (stream.get(), sampleRate, (unsigned int) numChannels,
+                                                                            settings.bitDepth, {}, 0));
+
+            if (writer != nullptr)
+                stream.release(); // now owned by the writer
+
+            return writer;
+        }
+
+        JUCE_DECLARE_NON_COPYABLE (BatchRenderer)
+    };
+
+    //==============================================================================
+    std::vector<Stem> findStems (const BatchSettings& settings)
+    {
+        AudioFormatManager formats;
+        formats.registerBasicFormats();
+
+        /* two copies of one stem must not write the same file at once */
+        if (settings.repeat > 1 && settings.outputFolder != File())
+            ConsoleApplication::fail ("--repeat is for timing, use it without --out-dir");
+
+        std::vector<Stem> stems;
+        StringPairArray outputNames;    // output file name -> the stem that writes it, ignoring case as some file systems do
+
+        for (auto& file : settings.inputFolder.findChildFiles (File::findFiles, false, formats.getWildcardForAllFormats()))
+        {
+            File output;
+
+            /* a.wav and a.flac would both write a.wav, from two workers at once */
+            if (settings.outputFolder != File())
+            {
+                output = settings.outputFolder.getChildFile (file.getFileNameWithoutExtension() + ".wav");
+
+                if (outputNames.containsKey (output.getFileName()))
+                    ConsoleApplication::fail (file.getFileName() + " and " + outputNames[output.getFileName()]
+                                              + " would both be rendered to " + output.getFullPathName());
+
+                outputNames.set (output.getFileName(), file.getFileName());
+            }
+
+            for (int i = 0; i < settings.repeat; ++i)
+                stems.push_back ({ file, output, file.getSize() });
+        }
+
+        if (stems.empty())
+            ConsoleApplication::fail ("no audio files in " + settings.inputFolder.getFullPathName());
+
+        return stems;
+    }
+
+    int renderBatch (const BatchSettings& settings)
+    {
+        auto stems = findStems (settings);
+        const auto numStems = stems.size();
+
+        if (settings.outputFolder != File() && ! settings.outputFolder.createDirectory())
+            ConsoleApplication::fail ("cannot create " + settings.outputFolder.getFullPathName());
+
+        BatchRenderer renderer (settings, std::move (stems));
+        const auto wallSeconds = renderer.run();
+
+        //==============================================================================
+        int64 totalSamples = 0;
+        double audioSeconds = 0, busySeconds = 0;
+        int totalStolen = 0;
+        StringArray errors;
+
+        for (auto& worker : renderer.getWorkers())
+        {
+            totalSamples += worker->numSamples;
+            audioSeconds += worker->audioSeconds;
+            busySeconds  += Time::highResolutionTicksToSeconds (worker->busyTicks);
+            totalStolen  += worker->numStolen;
+            errors.addArray (worker->errors);
+        }
+
+        for (auto& error : errors)
+            std::cerr << error << "\n";
+
+        const auto numThreads = settings.numThreads;
+
+        std::cout << "rendered        " << (int) numStems - errors.size() << " of " << numStems << " stems, "
+                  << audioSeconds << " s of audio, on " << numThreads << " threads, block " << settings.blockSize << "\n"
+                  << "wall clock      " << wallSeconds << " s (" << totalStolen << " stems stolen)\n"
+                  << "realtime factor " << (wallSeconds > 0 ? audioSeconds / wallSeconds : 0.0) << "x for the batch\n"
+                  << "throughput      " << (wallSeconds > 0 ? (double) totalSamples / wallSeconds / 1.0e6 : 0.0)
+                  << " M sample frames/s, " << (busySeconds > 0 ? (double) totalSamples / busySeconds / 1.0e6 : 0.0)
+                  << " per thread in processBlock\n"
+                  << "processBlock    " << (wallSeconds > 0 ? 100.0 * busySeconds / (wallSeconds * numThreads) : 0.0)
+                  << "% of the threads' wall clock time\n";
+
+        return errors.isEmpty() ? 0 : 1;
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    ScopedJuceInitialiser_GUI juceInitialiser; // the parameter tree and processor expect a message manager
+
+    ArgumentList args (argc, argv);
+
+    return ConsoleApplication::invokeCatchingFailures ([&]
+    {
+        BatchSettings settings;
+
+        if (args.containsOption ("--help|-h") || ! parseSettings (args, settings))
+        {
+            printUsage();
+            return args.containsOption ("--help|-h") ? 0 : 1;
+        }
+
+        return renderBatch (settings);
+    });
+}
@@ -0,0 +1,1089 @@
+/*
+  ==============================================================================
+
+    VariDelayBench.cpp
+
+    Microbenchmarks for DelayLine, Delay<float>::process, FeedbackDelayNetwork and
+    VariDelayAudioProcessor::processBlock. Every result is printed as one
+    JSON object per line so runs can be collected and diffed by scripts.
+
+    VariDelayBench [--quick] [--filter <substring>] [--rate 48000]
+                   [--min-time 0.05] [--out results.jsonl]
+
+    VariDelayBench --verify checks the optimised delay kernels against the
+    scalar Delay, the FFT dense taps against the direct ones and the double
+    precision processBlock against the float one, checks that a dense
+    automation ramp still splits processBlock, and exits with a non-zero
+    status if any of them fails.
+
+    VariDelayBench --response prints the magnitude and phase delay of each
+    fractional-delay interpolation policy.
+
+    VariDelayBench --rt-check [--runs 100] runs processBlock over randomised
+    layouts, block sizes, taps and automation with RealtimeSafetyChecker
+    watching, and fails if it ever allocates, frees or locks.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../PluginProcessor.h"
+#include "../Delay.h"
+#include "../InterleavedDelay.h"
+#include "../PagedDelayLine.h"
+#include "../StorageCodec.h"
+#include "../FeedbackDelayNetwork.h"
+#include "RealtimeSafetyChecker.h"
+
+#include <complex>
+#include <iostream>
+
+//==============================================================================
+/* the processor's friend, so the realtime-safety check can call its private parameter listener */
+struct VariDelayTestAccess
+{
+    static void parameterChanged (VariDelayAudioProcessor& processor, const String& parameterID, float newValue)
+    {
+        processor.parameterChanged (parameterID, newValue);
+    }
+};
+
+namespace
+{
+    struct BenchSettings
+    {
+        double sampleRate = 48000.0;
+        double minSeconds = 0.05;   // minimum measured time per repetition
+        int repetitions = 5;        // the median repetition is reported
+        String filter;
+
+        std::vector<int>    blockSizes { 16, 64, 256, 1024, 4096 };
+        std::vector<double> delayTimesMs { 1.0, 10.0, 100.0, 2000.0 };
+    };
+
+    struct BenchResult
+    {
+        String name, layout;
+        int numChannels = 0;
+        int blockSize = 0;
+        double delayMs = 0;
+        double nsPerSample = 0;         // per sample frame (all channels)
+        double nsPerChannelSample = 0;  // per sample of a single channel
+        double maxError = -1;           // measured accuracy, where the bench has one
+        int numLines = 0;               // delay lines in a feedback delay network
+
+        String toJson() const
+        {
+            auto* object = new DynamicObject();
+            object->setProperty ("bench", name);
+            object->setProperty ("layout", layout);
+            object->setProperty ("channels", numChannels);
+            object->setProperty ("block", blockSize);
+            object->setProperty ("delay_ms", delayMs);
+            object->setProperty ("ns_per_sample", nsPerSample);
+            object->setProperty ("ns_per_channel_sample", nsPerChannelSample);
+
+            if (maxError >= 0)
+                object->setProperty ("max_error", maxError);
+
+            if (numLines > 0)
+            {
+                object->setProperty ("lines", numLines);
+                object->setProperty ("ns_per_line_sample", nsPerSample / numLines);
+            }
+
+            return JSON::toString (var (object), true);
+        }
+    };
+
+    //==============================================================================
+    /**
+        Runs one block-processing callback until at least minSeconds worth of
+        processing has been measured, repeats that a few times and returns the
+        median cost of a sample frame in nanoseconds. Only the time spent
+        inside processBlock is counted, so refilling the input is free.
+    */
+    template <typename PrepareBlock, typename ProcessBlock>
+    double measureNsPerSample (const BenchSettings& settings, int blockSize,
+                               PrepareBlock&& prepareBlock, ProcessBlock&& processBlock)
+    {
+        const auto minTicks = (int64) (settings.minSeconds * (double) Time::getHighResolutionTicksPerSecond());
+
+        /* warm up caches, branch predictors and the delay memory */
+        for (int i = 0; i < 8; ++i)
+        {
+            prepareBlock();
+            processBlock();
+        }
+
+        std::vector<double> runs;
+
+        for (int rep = 0; rep < settings.repetitions; ++rep)
+        {
+            int64 ticks = 0, samples = 0;
+
+            while (ticks < minTicks)
+            {
+                prepareBlock();
+
+                const auto start = Time::getHighResolutionTicks();
+                processBlock();
+                ticks += Time::getHighResolutionTicks() - start;
+
+                samples += blockSize;
+            }
+
+            runs.push_back (Time::highResolutionTicksToSeconds (ticks) * 1.0e9 / (double) samples);
+        }
+
+        std::sort (runs.begin(), runs.end());
+        return runs[runs.size() / 2];
+    }
+
+    template <typename SampleType>
+    void fillWithNoise (AudioBuffer<SampleType>& buffer, Random& random)
+    {
+        for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+        {
+            auto* data = buffer.getWritePointer (ch);
+
+            for (int i = 0; i < buffer.getNumSamples(); ++i)
+                data[i] = (SampleType) (random.nextFloat() * 0.5f - 0.25f);
+        }
+    }
+
+    /** numTaps taps spread at random over up to maxDelayMs, the same set for a given seed */
+    std::vector<DelayTap> makeTapCloud (int numTaps, double maxDelayMs, int seed)
+    {
+        Random random (seed);
+        std::vector<DelayTap> taps;
+
+        for (int t = 0; t < numTaps; ++t)
+            taps.push_back ({ (float) (random.nextDouble() * maxDelayMs),
+                              (random.nextFloat() - 0.5f) * 4.0f / (float) numTaps,
+                              random.nextFloat() * 2.0f - 1.0f });
+
+        return taps;
+    }
+
+    /** A stereo delay memory as the processor lays it out, with room for a block past maxDelaySamples */
+    AudioBuffer<float> makeDelayMemory (int maxDelaySamples, int blockSize)
+    {
+        AudioBuffer<float> memory (2, nextPowerOfTwo (maxDelaySamples + blockSize));
+        memory.clear();
+        return memory;
+    }
+
+    void writeNoise (AudioBuffer<float>& memory, int writePos, int numSamples, Random& random)
+    {
+        const auto mask = memory.getNumSamples() - 1;
+
+        for (int ch = 0; ch < memory.getNumChannels(); ++ch)
+            for (int i = 0; i < numSamples; ++i)
+                memory.setSample (ch, (writePos + i) & mask, random.nextFloat() * 0.5f - 0.25f);
+    }
+
+    //==============================================================================
+    class BenchRunner
+    {
+    public:
+        BenchRunner (const BenchSettings& s, OutputStream* file) : settings (s), output (file) {}
+
+        bool wants (const String& name) const
+        {
+            return settings.filter.isEmpty() || name.containsIgnoreCase (settings.filter);
+        }
+
+        void report (const BenchResult& result)
+        {
+            auto line = result.toJson();
+            std::cout << line << std::endl;
+
+            if (output != nullptr)
+                *output << line << newLine;
+        }
+
+        //==============================================================================
+        void runDelayLine()
+        {
+            const String name ("DelayLine::push_get");
+
+            if (! wants (name))
+                return;
+
+            for (auto delayMs : settings.delayTimesMs)
+            {
+                const auto delaySamples = (size_t) jmax (1, roundToInt (delayMs * 0.001 * settings.sampleRate));
+
+                DelayLine<float> line;
+                line.resize (delaySamples + 1);
+                line.clear();
+
+                for (auto blockSize : settings.blockSizes)
+                {
+                    AudioBuffer<float> buffer (1, blockSize);
+                    Random random (1);
+
+                    auto nsPerSample = measureNsPerSample (settings, blockSize,
+                        [&] { fillWithNoise (buffer, random); },
+                        [&]
+                        {
+                            auto* data = buffer.getWritePointer (0);
+
+                            for (int i = 0; i < blockSize; ++i)
+                            {
+                                auto delayed = line.get (delaySamples - 1);
+                                line.push (data[i] + 0.5f * delayed);
+                                data[i] = delayed;
+                            }
+                        });
+
+                    report ({ name, "mono", 1, blockSize, delayMs, nsPerSample, nsPerSample });
+                }
+            }
+        }
+
+        //==============================================================================
+        /*
+            configure runs before prepare(). With a rateMultiplier the delay runs
+            at that multiple of the sample rate, on blocks that much longer, and
+            the results are still per sample at the base rate.
+        */
+        template <typename DelayType, typename SampleType = float>
+        void runDelay (const String& name, const String& layout,
+                       std::function<void (DelayType&)> configure = nullptr, int rateMultiplier = 1)
+        {
+            if (! wants (name))
+                return;
+
+            for (auto delayMs : settings.delayTimesMs)
+            {
+                const auto delaySeconds = (float) (delayMs * 0.001);
+
+                for (auto blockSize : settings.blockSizes)
+                {
+                    const auto processedBlockSize = blockSize * rateMultiplier;
+
+                    DelayType delay;
+                    const auto numChannels = delay.getNumChannels();
+                    delay.setMaxDelayTime (delaySeconds * 1.1f + 0.001f);
+
+                    for (size_t ch = 0; ch < numChannels; ++ch)
+                        delay.setDelayTime (ch, delaySeconds);
+
+                    if (configure != nullptr)
+                        configure (delay);
+
+                    delay.prepare ({ settings.sampleRate * rateMultiplier, (uint32) processedBlockSize, (uint32) numChannels });
+                    delay.reset();
+
+                    AudioBuffer<SampleType> buffer ((int) numChannels, processedBlockSize);
+                    Random random (1);
+
+                    auto nsPerSample = rateMultiplier * measureNsPerSample (settings, processedBlockSize,
+                        [&] { fillWithNoise (buffer, random); },
+                        [&]
+                        {
+                            dsp::AudioBlock<SampleType> block (buffer);
+                            delay.process (dsp::ProcessContextReplacing<SampleType> (block));
+                        });
+
+                    report ({ name, layout, (int) numChannels, blockSize, delayMs,
+                              nsPerSample, nsPerSample / (double) numChannels });
+                }
+            }
+        }
+
+        //==============================================================================
+        /*
+            A stereo network with its lines spread between half the delay time
+            and the whole of it. Also reports the cost per line, which is what
+            sizing a network against a CPU budget needs.
+        */
+        template <size_t numLines, typename MixingType>
+        void runFeedbackDelayNetwork (const String& name)
+        {
+            if (! wants (name))
+                return;
+
+            constexpr int numChannels = 2;
+
+            for (auto delayMs : settings.delayTimesMs)
+            {
+                const auto delaySeconds = (float) (delayMs * 0.001);
+
+                for (auto blockSize : settings.blockSizes)
+                {
+                    FeedbackDelayNetwork<float, numLines, MixingType> network;
+                    network.setMaxDelayTime (delaySeconds * 1.1f + 0.001f);
+                    network.spreadDelayTimes (delaySeconds * 0.5f, delaySeconds);
+                    network.setDamping (Damping::Mode::onePoleLowpass, 6000.0f);
+                    network.prepare ({ settings.sampleRate, (uint32) blockSize, (uint32) numChannels });
+                    network.reset();
+
+                    AudioBuffer<float> buffer (numChannels, blockSize);
+                    Random random (1);
+
+                    auto nsPerSample = measureNsPerSample (settings, blockSize,
+                        [&] { fillWithNoise (buffer, random); },
+                        [&]
+                        {
+                            dsp::AudioBlock<float> block (buffer);
+                            network.process (dsp::ProcessContextReplacing<float> (block));
+                        });
+
+                    BenchResult result { name, "Stereo, " + String (numLines) + " lines", numChannels, blockSize, delayMs,
+                                         nsPerSample, nsPerSample / numChannels };
+                    result.numLines = (int) numLines;
+                    report (result);
+                }
+            }
+        }
+
+        //==============================================================================
+        /** The cost of one saturator call on its own, plus its measured error against std::tanh */
+        template <typename Saturator>
+        void runSaturator (const String& name)
+        {
+            if (! wants (name))
+                return;
+
+            Saturator::template prepare<float>();
+
+            double maxError = 0;
+
+            for (double x = -12.0; x <= 12.0; x += 1.0e-4)
+            {
+                auto input = (float) x;
+                maxError = jmax (maxError, std::abs ((double) Saturator::process (input) - std::tanh ((double) input)));
+            }
+
+            for (auto blockSize : settings.blockSizes)
+            {
+                AudioBuffer<float> buffer (1, blockSize);
+                Random random (1);
+
+                auto nsPerSample = measureNsPerSample (settings, blockSize,
+                    [&]
+                    {
+                        fillWithNoise (buffer, random);
+                        buffer.applyGain (12.0f); // +/-3, well into the curve
+                    },
+                    [&]
+                    {
+                        auto* data = buffer.getWritePointer (0);
+
+                        for (int i = 0; i < blockSize; ++i)
+                            data[i] = Saturator::process (data[i]);
+                    });
+
+                report ({ name, "mono", 1, blockSize, 0.0, nsPerSample, nsPerSample, maxError });
+            }
+        }
+
+        //==============================================================================
+        /** Dense taps over 2 seconds, read out of a stereo delay memory, in the given mode */
+        void runDenseTaps (int numTaps, DenseTaps::Mode mode, const char* modeName)
+        {
+            const auto name = "DenseTaps::process (" + String (numTaps) + " taps, " + modeName + ")";
+
+            if (! wants (name))
+                return;
+
+            const float positions[] = { -1.0f, 1.0f };
+            const auto maxDelaySamples = (int) std::ceil (2.0 * settings.sampleRate);
+            const auto taps = makeTapCloud (numTaps, 2000.0, 3);
+
+            for (auto blockSize : settings.blockSizes)
+            {
+                DenseTaps engine (taps, settings.sampleRate, 2, positions, maxDelaySamples, mode);
+                auto memory = makeDelayMemory (maxDelaySamples, blockSize);
+                AudioBuffer<float> buffer (2, blockSize);
+                Random random (1);
+                int writePos = 0;
+
+                auto nsPerSample = measureNsPerSample (settings, blockSize,
+                    [&]
+                    {
+                        writePos = (writePos + blockSize) & (memory.getNumSamples() - 1);
+                        writeNoise (memory, writePos, blockSize, random);
+                        buffer.clear();
+                    },
+                    [&] { engine.process (memory, writePos, buffer.getArrayOfWritePointers(), blockSize); });
+
+                report ({ name + ", partition " + String (engine.getPartitionSize()), "Stereo", 2, blockSize, 2000.0,
+                          nsPerSample, nsPerSample / 2.0 });
+            }
+        }
+
+        //==============================================================================
+        /*
+            With changeEveryBlock set, the feedback parameter moves before every
+            block, the way dense host automation does. Publishing happens outside
+            the timed region, so the difference to the plain run is what the
+            audio thread pays for picking up a new parameter snapshot.
+
+            With SampleType double the processor runs in double precision, as
+            it does for a host with a 64-bit mix bus.
+        */
+        template <typename SampleType = float>
+        void runProcessBlock (const AudioChannelSet& channelSet, bool changeEveryBlock = false, int numTaps = 0)
+        {
+            String name ("VariDelayAudioProcessor::processBlock");
+
+            if (std::is_same<SampleType, double>::value)
+                name << " (double)";
+
+            if (changeEveryBlock)
+                name << " (parameter change every block)";
+
+            if (numTaps > 0)
+                name << " (" << numTaps << " taps)";
+
+            if (! wants (name))
+                return;
+
+            const auto layout = channelSet.getDescription();
+
+            for (auto delayMs : settings.delayTimesMs)
+            {
+                for (auto blockSize : settings.blockSizes)
+                {
+                    VariDelayAudioProcessor processor;
+
+                    AudioProcessor::BusesLayout buses;
+                    buses.inputBuses.add (channelSet);
+                    buses.outputBuses.add (channelSet);
+
+                    if (! processor.setBusesLayout (buses))
+                    {
+                        std::cerr << "skipping processBlock: layout not supported (" << layout << ")" << std::endl;
+                        return;
+                    }
+
+                    for (auto* id : { "Time L", "Time R" })
+                    {
+                        auto* parameter = processor.apvts.getParameter (id);
+                        parameter->setValueNotifyingHost (parameter->convertTo0to1 ((float) jmin (delayMs, 2000.0)));
+                    }
+
+                    /* taps spread evenly up to the delay time, alternating sides */
+                    TapPattern taps;
+                    taps.numTaps = numTaps;
+
+                    for (int t = 0; t < numTaps; ++t)
+                        taps.taps[(size_t) t] = { (float) (delayMs * (t + 1) / numTaps), 0.5f, (t & 1) == 0 ? -0.7f : 0.7f };
+
+                    processor.setTapPattern (taps);
+
+                    processor.setNonRealtime (true);
+                    processor.setProcessingPrecision (std::is_same<SampleType, double>::value ? AudioProcessor::doublePrecision
+                                                                                               : AudioProcessor::singlePrecision);
+                    processor.setRateAndBufferSizeDetails (settings.sampleRate, blockSize);
+                    processor.prepareToPlay (settings.sampleRate, blockSize);
+
+                    const auto numChannels = jmax (processor.getTotalNumInputChannels(),
+                                                   processor.getTotalNumOutputChannels());
+
+                    AudioBuffer<SampleType> buffer (numChannels, blockSize);
+                    MidiBuffer midi;
+                    Random random (1);
+
+                    auto* feedback = processor.apvts.getParameter ("FB L");
+                    bool toggle = false;
+
+                    auto nsPerSample = measureNsPerSample (settings, blockSize,
+                        [&]
+                        {
+                            fillWithNoise (buffer, random);
+
+                            if (changeEveryBlock)
+                                feedback->setValueNotifyingHost (feedback->convertTo0to1 ((toggle = ! toggle) ? -6.0f : -12.0f));
+                        },
+                        [&] { processor.processBlock (buffer, midi); });
+
+                    report ({ name, layout, numChannels, blockSize, delayMs,
+                              nsPerSample, nsPerSample / (double) numChannels });
+
+                    processor.releaseResources();
+                }
+            }
+        }
+
+    private:
+        const BenchSettings& settings;
+        OutputStream* output;
+    };
+
+    //==============================================================================
+    /**
+        Runs two delay implementations side by side on the same noise, with a
+        different delay time on every channel and varying block sizes, and
+        returns the largest difference between their outputs.
+    */
+    template <typename DelayA, typename DelayB>
+    double compareDelays (double sampleRate)
+    {
+        DelayA a;
+        DelayB b;
+        const auto numChannels = a.getNumChannels();
+        jassert (numChannels == b.getNumChannels());
+
+        auto setUp = [&] (auto& delay)
+        {
+            delay.setMaxDelayTime (0.05f);
+
+            for (size_t ch = 0; ch < numChannels; ++ch)
+                delay.setDelayTime (ch, 0.0005f * (float) (ch % 5) + 0.0001f * (float) ch);
+
+            delay.setFeedback (0.7f);
+            delay.setWetLevel (0.6f);
+            delay.prepare ({ sampleRate, 512, (uint32) numChannels });
+            delay.reset();
+        };
+
+        setUp (a);
+        setUp (b);
+
+        Random random (7);
+        double maxError = 0;
+
+        for (int i = 0; i < 400; ++i)
+        {
+            const auto numSamples = 1 + random.nextInt (512);
+
+            AudioBuffer<float> bufferA ((int) numChannels, numSamples);
+            fillWithNoise (bufferA, random);
+            AudioBuffer<float> bufferB (bufferA);
+
+            dsp::AudioBlock<float> blockA (bufferA), blockB (bufferB);
+            a.process (dsp::ProcessContextReplacing<float> (blockA));
+            b.process (dsp::ProcessContextReplacing<float> (blockB));
+
+            for (int ch = 0; ch < (int) numChannels; ++ch)
+                for (int n = 0; n < numSamples; ++n)
+                    maxError = jmax (maxError, (double) std::abs (bufferA.getSample (ch, n) - bufferB.getSample (ch, n)));
+        }
+
+        return maxError;
+    }
+
+    /**
+        Runs the same dense taps directly and through the partitioned FFT on
+        the same delay memory, with varying block sizes, and returns the
+        largest difference relative to the largest output.
+    */
+    double compareDenseTaps (double sampleRate)
+    {
+        const float positions[] = { -1.0f, 1.0f };
+        const auto maxDelaySamples = (int) std::ceil (0.5 * sampleRate);
+        const auto taps = makeTapCloud (300, 500.0, 5);
+
+        DenseTaps direct (taps, sampleRate, 2, positions, maxDelaySamples, DenseTaps::Mode::direct);
+        DenseTaps convolved (taps, sampleRate, 2, positions, maxDelaySamples, DenseTaps::Mode::fft);
+
+        auto memory = makeDelayMemory (maxDelaySamples, 512);
+        Random random (7);
+        int writePos = 0;
+        double maxError = 0, peak = 0;
+
+        for (int i = 0; i < 400; ++i)
+        {
+            const auto numSamples = 1 + random.nextInt (512);
+            writeNoise (memory, writePos, numSamples, random);
+
+            AudioBuffer<float> bufferA (2, numSamples), bufferB (2, numSamples);
+            bufferA.clear();
+            bufferB.clear();
+
+            direct.process (memory, writePos, bufferA.getArrayOfWritePointers(), numSamples);
+            convolved.process (memory, writePos, bufferB.getArrayOfWritePointers(), numSamples);
+
+            for (int ch = 0; ch < 2; ++ch)
+            {
+                for (int n = 0; n < numSamples; ++n)
+                {
+                    peak = jmax (peak, (double) std::abs (bufferA.getSample (ch, n)));
+                    maxError = jmax (maxError, (double) std::abs (bufferA.getSample (ch, n) - bufferB.getSample (ch, n)));
+                }
+            }
+
+            writePos = (writePos + numSamples) & (memory.getNumSamples() - 1);
+        }
+
+        return peak > 0 ? maxError / peak : maxError;
+    }
+
+    /**
+        Runs the processor in single and in double precision on the same
+        noise, with taps, and returns the largest difference between the two.
+    */
+    double compareProcessingPrecision (double sampleRate)
+    {
+        VariDelayAudioProcessor single, twice;
+        TapPattern taps;
+        taps.numTaps = 4;
+
+        for (int t = 0; t < taps.numTaps; ++t)
+            taps.taps[(size_t) t] = { 30.0f * (float) (t + 1), 0.4f, (t & 1) == 0 ? -0.5f : 0.5f };
+
+        for (auto* processor : { &single, &twice })
+        {
+            processor->setTapPattern (taps);
+            processor->setNonRealtime (true);
+            processor->setProcessingPrecision (processor == &twice ? AudioProcessor::doublePrecision
+                                                                   : AudioProcessor::singlePrecision);
+            processor->setRateAndBufferSizeDetails (sampleRate, 512);
+            processor->prepareToPlay (sampleRate, 512);
+        }
+
+        Random random (7);
+        MidiBuffer midi;
+        double maxError = 0;
+
+        for (int i = 0; i < 400; ++i)
+        {
+            const auto numSamples = 1 + random.nextInt (512);
+
+            AudioBuffer<float> bufferA (2, numSamples);
+            fillWithNoise (bufferA, random);
+
+            AudioBuffer<double> bufferB (2, numSamples);
+            bufferB.makeCopyOf (bufferA);
+
+            single.processBlock (bufferA, midi);
+            twice.processBlock (bufferB, midi);
+
+            for (int ch = 0; ch < 2; ++ch)
+                for (int n = 0; n < numSamples; ++n)
+                    maxError = jmax (maxError, std::abs ((double) bufferA.getSample (ch, n) - bufferB.getSample (ch, n)));
+        }
+
+        return maxError;
+    }
+
+    /**
+        Schedules a ramp of delay time steps, each smaller than the processor's
+        0.5 ms split threshold, across one block, and returns how many fewer
+        segments the block was split into than the ramp's movement calls for.
+        Zero means dense automation still lands close to where it was sent.
+    */
+    double checkAutomationRampSplits (double sampleRate)
+    {
+        constexpr int blockSize = 512, stepSamples = 16;
+        constexpr float stepMs = 0.3f, thresholdMs = 0.5f;
+
+        VariDelayAudioProcessor processor;
+        processor.setRateAndBufferSizeDetails (sampleRate, blockSize);
+        processor.prepareToPlay (sampleRate, blockSize);
+
+        const auto startMs = processor.apvts.getRawParameterValue ("Time L")->load();
+        int numSteps = 0;
+
+        for (int position = stepSamples; position < blockSize; position += stepSamples)
+            processor.scheduleParameterChange ("Time L", startMs + stepMs * (float) ++numSteps, position);
+
+        AudioBuffer<float> buffer (2, blockSize);
+        Random random (7);
+        fillWithNoise (buffer, random);   // not silent, or the block would be skipped unsplit
+
+        MidiBuffer midi;
+        auto cursor = processor.getBlockTimings().getNumPushed();
+        processor.processBlock (buffer, midi);
+
+        int numSegments = 0;
+        processor.getBlockTimings().read (cursor, [&] (const BlockTiming& timing) { numSegments += timing.numSegments; });
+
+        /* a split once the ramp has moved the threshold, which takes a whole number of steps */
+        const auto stepsPerSplit = (int) std::ceil (thresholdMs / stepMs);
+        return (double) jmax (0, numSteps / stepsPerSplit - numSegments);
+    }
+
+    /** Checks the fast paths against the plain ones; returns false if any of them disagrees */
+    bool runVerification (double sampleRate)
+    {
+        struct Check { const char* name; double maxError; double tolerance; };
+
+        const Check checks[] =
+        {
+            { "InterleavedDelay<float, 2>",           compareDelays<Delay<float, 2>,  InterleavedDelay<float, 2>>  (sampleRate), 1.0e-5 },
+            { "InterleavedDelay<float, 6>",           compareDelays<Delay<float, 6>,  InterleavedDelay<float, 6>>  (sampleRate), 1.0e-5 },
+            { "InterleavedDelay<float, 16>",          compareDelays<Delay<float, 16>, InterleavedDelay<float, 16>> (sampleRate), 1.0e-5 },
+            { "InterleavedDelay<float, 16, scalar>",  compareDelays<Delay<float, 16>, InterleavedDelay<float, 16, ScalarLanes<float>>> (sampleRate), 1.0e-5 },
+            { "DenseTaps (fft against direct)",       compareDenseTaps (sampleRate), 1.0e-4 },   // relative: the FFT rounds differently
+            { "processBlock (double against float)",  compareProcessingPrecision (sampleRate), 1.0e-4 },  // float rounding, recirculated
+            { "processBlock (dense automation ramp)", checkAutomationRampSplits (sampleRate), 0.0 },     // segments short of one per threshold
+
+            /* lossy storage: these bound the quantisation error rather than check for equality */
+            { "CompressedDelayLine<HalfFloat>",       compareDelays<Delay<float, 2>, Delay<float, 2, Saturation::Tanh, Interpolation::None, CompressedDelayLine<float, StorageCodec::HalfFloat>>> (sampleRate), 1.0e-3 },
+            { "CompressedDelayLine<Int16>",           compareDelays<Delay<float, 2>, Delay<float, 2, Saturation::Tanh, Interpolation::None, CompressedDelayLine<float, StorageCodec::Int16>>> (sampleRate), 2.0e-4 },
+        };
+
+        bool passed = true;
+
+        for (auto& check : checks)
+        {
+            auto* object = new DynamicObject();
+            object->setProperty ("verify", check.name);
+            object->setProperty ("max_error", check.maxError);
+            object->setProperty ("passed", check.maxError <= check.tolerance);
+            std::cout << JSON::toString (var (object), true) << std::endl;
+
+            passed = passed && check.maxError <= check.tolerance;
+        }
+
+        return passed;
+    }
+
+    //==============================================================================
+    /**
+        Feeds one prepared processor a few hundred blocks of random length,
+        some longer than it was prepared for, with stretches of silence for
+        the skip. Between blocks it does what a host and an editor would:
+        parameter changes, sample-accurate automation inside the next block,
+        new tap patterns and dense taps. Only processBlock itself runs under
+        the checker, together with the parameter listener when the change
+        comes from the host: the VST3 and AU wrappers apply automation inside
+        process(), so the listener is called on the audio thread.
+    */
+    template <typename SampleType>
+    void checkProcessBlock (VariDelayAudioProcessor& processor, Random& random, int maxBlockSize)
+    {
+        const auto numChannels = jmax (processor.getTotalNumInputChannels(), processor.getTotalNumOutputChannels());
+        const auto& parameters = processor.getParameters();
+
+        AudioBuffer<SampleType> buffer (numChannels, 2 * maxBlockSize);
+        MidiBuffer midi;
+        int64 position = 0;     // the processor counts from prepareToPlay too
+
+        for (int block = 0; block < 300; ++block)
+        {
+            const auto numSamples = 1 + random.nextInt (random.nextInt (8) == 0 ? 2 * maxBlockSize : maxBlockSize);
+            buffer.setSize (numChannels, numSamples, false, false, true);
+
+            if ((block / 50) % 2 == 1)
+                buffer.clear();
+            else
+                fillWithNoise (buffer, random);
+
+            /* half the changes are the host's, whose listener call is repeated inside the check below */
+            const auto changesParameter = random.nextInt (4) == 0;
+            const auto isHostAutomation = changesParameter && random.nextBool();
+            auto* automated = dynamic_cast<RangedAudioParameter*> (parameters[random.nextInt (parameters.size())]);
+
+            if (changesParameter)
+                automated->setValueNotifyingHost (random.nextFloat());
+
+            for (int i = random.nextInt (4); --i >= 0;)
+            {
+                if (auto* parameter = dynamic_cast<RangedAudioParameter*> (parameters[random.nextInt (parameters.size())]))
+                    processor.scheduleParameterChange (parameter->paramID, parameter->convertFrom0to1 (random.nextFloat()),
+                                                       position + random.nextInt (numSamples));
+            }
+
+            if (random.nextInt (20) == 0)
+            {
+                TapPattern taps;
+                taps.numTaps = random.nextInt (TapPattern::maxNumTaps + 1);
+
+                for (int t = 0; t < taps.numTaps; ++t)
+                    taps.taps[(size_t) t] = { random.nextFloat() * 2000.0f, random.nextFloat() * 0.5f, random.nextFloat() * 2.0f - 1.0f };
+
+                processor.setTapPattern (taps);
+            }
+
+            if (random.nextInt (60) == 0)
+                processor.setDenseTaps (makeTapCloud (random.nextInt (DenseTaps::maxNumTaps + 1), 2000.0, random.nextInt()));
+
+            {
+                const RealtimeSafetyChecker::ScopedAudioThread audioThread;
+
+                /* only our listener: the parameter's own dispatch to it takes JUCE's listenerLock first */
+                if (isHostAutomation)
+                {
+                    VariDelayTestAccess::parameterChanged (processor, automated->paramID,
+                                                           automated->convertFrom0to1 (automated->getValue()));
+                }
+
+                processor.processBlock (buffer, midi);
+            }
+
+            position += numSamples;
+        }
+    }
+
+    /** Returns false if processBlock allocated, freed or locked in any of numRuns randomised setups */
+    bool runRealtimeChecks (double sampleRate, int numRuns)
+    {
+        const AudioChannelSet layouts[] = { AudioChannelSet::mono(), AudioChannelSet::stereo(),
+                                            AudioChannelSet::create5point1(), AudioChannelSet::ambisonic (3) };
+        const int blockSizes[] = { 16, 64, 128, 256, 512, 1024, 2048 };
+        const double sampleRates[] = { sampleRate, 44100.0, 96000.0 };
+
+        Random random (0x5afe);
+        RealtimeSafetyChecker::resetCounts();
+
+        for (int run = 0; run < numRuns; ++run)
+        {
+            VariDelayAudioProcessor processor;
+
+            AudioProcessor::BusesLayout buses;
+            const auto& layout = layouts[random.nextInt (numElementsInArray (layouts))];
+            buses.inputBuses.add (layout);
+            buses.outputBuses.add (layout);
+            processor.setBusesLayout (buses);
+
+            for (auto* parameter : processor.getParameters())
+                parameter->setValueNotifyingHost (random.nextFloat());
+
+            if (random.nextBool())
+                processor.setDenseTaps (makeTapCloud (random.nextInt (DenseTaps::maxNumTaps + 1), 2000.0, random.nextInt()));
+
+            const auto isDouble = random.nextBool();
+            const auto blockSize = blockSizes[random.nextInt (numElementsInArray (blockSizes))];
+            const auto rate = sampleRates[random.nextInt (numElementsInArray (sampleRates))];
+
+            processor.setProcessingPrecision (isDouble ? AudioProcessor::doublePrecision : AudioProcessor::singlePrecision);
+            processor.setRateAndBufferSizeDetails (rate, blockSize);
+            processor.prepareToPlay (rate, blockSize);
+
+            if (isDouble)
+                checkProcessBlock<double> (processor, random, blockSize);
+            else
+                checkProcessBlock<float> (processor, random, blockSize);
+
+            processor.releaseResources();
+        }
+
+        bool passed = true;
+
+        for (int i = 0; i < RealtimeSafetyChecker::numViolations; ++i)
+        {
+            const auto violation = (RealtimeSafetyChecker::Violation) i;
+            const auto count = RealtimeSafetyChecker::getCount (violation);
+            const auto isChecked = violation == RealtimeSafetyChecker::Violation::lock ? RealtimeSafetyChecker::canDetectMallocAndLocks() : true;
+
+            auto* object = new DynamicObject();
+            object->setProperty ("rt_check", RealtimeSafetyChecker::getName (violation));
+            object->setProperty ("runs", numRuns);
+            object->setProperty ("count", count);
+            object->setProperty ("checked", isChecked);
+            object->setProperty ("passed", count == 0);
+            std::cout << JSON::toString (var (object), true) << std::endl;
+
+            passed = passed && count == 0;
+        }
+
+        if (! passed)
+            std::cerr << RealtimeSafetyChecker::getFirstBacktrace() << std::endl;
+
+        return passed;
+    }
+
+    //==============================================================================
+    /**
+        Measures the impulse response of an interpolation policy's reader at a
+        fixed fractional delay and prints its magnitude and phase delay over
+        frequency, one JSON object per point.
+    */
+    template <typename InterpolationType>
+    void printResponse (const String& name, double delayInSamples)
+    {
+        constexpr int length = 512;
+
+        DelayLine<double> line;
+        line.resize (length);
+        line.clear();
+
+        typename InterpolationType::template Reader<double> reader;
+        reader.setDelay (delayInSamples);
+        reader.reset();
+
+        /* read after the push, so get (0) is the current input and the delay is exactly delayInSamples */
+        std::vector<double> impulseResponse (length);
+
+        for (int n = 0; n < length; ++n)
+        {
+            line.push (n == 0 ? 1.0 : 0.0);
+            impulseResponse[(size_t) n] = reader.read (line);
+        }
+
+        for (int step = 1; step <= 48; ++step)
+        {
+            const auto frequency = 0.01 * step;   // as a fraction of the sample rate, up to 0.48
+            const auto omega = MathConstants<double>::twoPi * frequency;
+
+            std::complex<double> response;
+
+            for (int n = 0; n < length; ++n)
+                response += impulseResponse[(size_t) n] * std::polar (1.0, -omega * n);
+
+            /* take the nominal delay out before reading the phase so it cannot wrap */
+            auto phaseDelay = delayInSamples - std::arg (response * std::polar (1.0, omega * delayInSamples)) / omega;
+
+            auto* object = new DynamicObject();
+            object->setProperty ("response", name);
+            object->setProperty ("delay_samples", delayInSamples);
+            object->setProperty ("frequency", frequency);
+            object->setProperty ("magnitude_db", Decibels::gainToDecibels (std::abs (response), -200.0));
+            object->setProperty ("phase_delay_samples", phaseDelay);
+            std::cout << JSON::toString (var (object), true) << std::endl;
+        }
+    }
+
+    void runResponses()
+    {
+        for (auto delay : { 10.0, 10.25, 10.5 })
+        {
+            printResponse<Interpolation::None>      ("Interpolation::None",      delay);
+            printResponse<Interpolation::Linear>    ("Interpolation::Linear",    delay);
+            printResponse<Interpolation::Lagrange3> ("Interpolation::Lagrange3", delay);
+            printResponse<Interpolation::Thiran>    ("Interpolation::Thiran",    delay);
+        }
+    }
+
+    //==============================================================================
+    int runBenchmarks (const ArgumentList& args)
+    {
+        BenchSettings settings;
+
+        if (args.containsOption ("--rate"))
+            settings.sampleRate = args.getValueForOption ("--rate").getDoubleValue();
+
+        if (args.containsOption ("--min-time"))
+            settings.minSeconds = args.getValueForOption ("--min-time").getDoubleValue();
+
+        if (args.containsOption ("--filter"))
+            settings.filter = args.getValueForOption ("--filter");
+
+        if (args.containsOption ("--quick"))
+        {
+            settings.repetitions = 3;
+            settings.minSeconds = jmin (settings.minSeconds, 0.01);
+            settings.blockSizes = { 64, 1024 };
+            settings.delayTimesMs = { 10.0, 2000.0 };
+        }
+
+        if (settings.sampleRate <= 0 || settings.minSeconds <= 0)
+            ConsoleApplication::fail ("--rate and --min-time must be positive");
+
+        if (args.containsOption ("--verify"))
+            return runVerification (settings.sampleRate) ? 0 : 1;
+
+        if (args.containsOption ("--rt-check"))
+        {
+            const auto numRuns = args.containsOption ("--runs") ? args.getValueForOption ("--runs").getIntValue() : 100;
+            return runRealtimeChecks (settings.sampleRate, jmax (1, numRuns)) ? 0 : 1;
+        }
+
+        if (args.containsOption ("--response"))
+        {
+            runResponses();
+            return 0;
+        }
+
+        std::unique_ptr<FileOutputStream> file;
+
+        if (args.containsOption ("--out"))
+        {
+            auto outFile = args.getFileForOption ("--out");
+            outFile.deleteFile();
+            file = outFile.createOutputStream();
+
+            if (file == nullptr)
+                ConsoleApplication::fail ("cannot open output file: " + outFile.getFullPathName());
+        }
+
+        BenchRunner runner (settings, file.get());
+
+        runner.runDelayLine();
+
+        runner.runDelay<Delay<float, 1>>  ("Delay::process", "Mono");
+        runner.runDelay<Delay<float, 2>>  ("Delay::process", "Stereo");
+        runner.runDelay<Delay<float, 6>>  ("Delay::process", "5.1 Surround");
+        runner.runDelay<Delay<float, 16>> ("Delay::process", "16 channels");
+
+        runner.runDelay<Delay<double, 2>, double>  ("Delay::process (double)", "Stereo");
+        runner.runDelay<Delay<double, 16>, double> ("Delay::process (double)", "16 channels");
+
+        runner.runSaturator<Saturation::Tanh>  ("Saturation::Tanh");
+        runner.runSaturator<Saturation::Pade>  ("Saturation::Pade");
+        runner.runSaturator<Saturation::Table> ("Saturation::Table");
+
+        runner.runDelay<Delay<float, 2, Saturation::Pade>>  ("Delay::process (Saturation::Pade)",  "Stereo");
+        runner.runDelay<Delay<float, 2, Saturation::Table>> ("Delay::process (Saturation::Table)", "Stereo");
+
+        using StereoDelay = Delay<float, 2>;
+
+        /* oversampling only the saturator, against running the whole delay at the higher rate */
+        for (size_t factorLog2 = 1; factorLog2 <= 3; ++factorLog2)
+        {
+            const auto factor = String (1 << factorLog2) + "x";
+
+            runner.runDelay<StereoDelay> ("Delay::process (saturator oversampled " + factor + ", IIR)", "Stereo",
+                                          [=] (StereoDelay& d) { d.setOversampling (factorLog2, StereoDelay::OversamplingFilter::iir); });
+            runner.runDelay<StereoDelay> ("Delay::process (saturator oversampled " + factor + ", FIR)", "Stereo",
+                                          [=] (StereoDelay& d) { d.setOversampling (factorLog2, StereoDelay::OversamplingFilter::fir); });
+            runner.runDelay<StereoDelay> ("Delay::process (whole delay at " + factor + " rate)", "Stereo",
+                                          nullptr, 1 << factorLog2);
+        }
+
+        runner.runDelay<StereoDelay> ("Delay::process (Damping::onePoleLowpass)", "Stereo",
+                                      [] (StereoDelay& d) { d.setDamping (Damping::Mode::onePoleLowpass, 4000.0f); });
+        runner.runDelay<StereoDelay> ("Delay::process (Damping::lowpass)", "Stereo",
+                                      [] (StereoDelay& d) { d.setDamping (Damping::Mode::lowpass, 4000.0f); });
+        runner.runDelay<StereoDelay> ("Delay::process (Damping::highpass)", "Stereo",
+                                      [] (StereoDelay& d) { d.setDamping (Damping::Mode::highpass, 200.0f); });
+
+        runner.runFeedbackDelayNetwork<8,  Mixing::Hadamard>    ("FeedbackDelayNetwork (Mixing::Hadamard)");
+        runner.runFeedbackDelayNetwork<16, Mixing::Hadamard>    ("FeedbackDelayNetwork (Mixing::Hadamard)");
+        runner.runFeedbackDelayNetwork<8,  Mixing::Householder> ("FeedbackDelayNetwork (Mixing::Householder)");
+        runner.runFeedbackDelayNetwork<16, Mixing::Householder> ("FeedbackDelayNetwork (Mixing::Householder)");
+
+        runner.runDelay<Delay<float, 2, Saturation::Tanh, Interpolation::Linear>>    ("Delay::process (Interpolation::Linear)",    "Stereo");
+        runner.runDelay<Delay<float, 2, Saturation::Tanh, Interpolation::Lagrange3>> ("Delay::process (Interpolation::Lagrange3)", "Stereo");
+        runner.runDelay<Delay<float, 2, Saturation::Tanh, Interpolation::Thiran>>    ("Delay::process (Interpolation::Thiran)",    "Stereo");
+
+        runner.runDelay<Delay<float, 2, Saturation::Tanh, Interpolation::None, PagedDelayLine<float>>> ("Delay::process (PagedDelayLine)", "Stereo");
+        runner.runDelay<Delay<float, 2, Saturation::Tanh, Interpolation::None, CompressedDelayLine<float, StorageCodec::HalfFloat>>> ("Delay::process (CompressedDelayLine<HalfFloat>)", "Stereo");
+        runner.runDelay<Delay<float, 2, Saturation::Tanh, Interpolation::None, CompressedDelayLine<float, StorageCodec::Int16>>>     ("Delay::process (CompressedDelayLine<Int16>)",     "Stereo");
+
+        runner.runDelay<InterleavedDelay<float, 2>>  ("InterleavedDelay::process", "Stereo");
+        runner.runDelay<InterleavedDelay<float, 6>>  ("InterleavedDelay::process", "5.1 Surround");
+        runner.runDelay<InterleavedDelay<float, 16>> ("InterleavedDelay::process", "16 channels");
+        runner.runDelay<InterleavedDelay<float, 16, ScalarLanes<float>>> ("InterleavedDelay::process (scalar)", "16 channels");
+        runner.runDelay<InterleavedDelay<float, 16, DefaultDelayLanes<float>, Saturation::Pade>> ("InterleavedDelay::process (Saturation::Pade)", "16 channels");
+
+        runner.runProcessBlock (AudioChannelSet::mono());
+        runner.runProcessBlock (AudioChannelSet::stereo());
+        runner.runProcessBlock (AudioChannelSet::create5point1());
+        runner.runProcessBlock (AudioChannelSet::discreteChannels (16));
+        runner.runProcessBlock (AudioChannelSet::ambisonic (3));
+        runner.runProcessBlock (AudioChannelSet::stereo(), true);
+        runner.runProcessBlock (AudioChannelSet::stereo(), false, 8);
+        runner.runProcessBlock (AudioChannelSet::stereo(), false, 32);
+
+        runner.runProcessBlock<double> (AudioChannelSet::stereo());
+        runner.runProcessBlock<double> (AudioChannelSet::discreteChannels (16));
+        runner.runProcessBlock<double> (AudioChannelSet::stereo(), false, 32);
+
+        for (auto numTaps : { 32, 256, 1024 })
+        {
+            runner.runDenseTaps (numTaps, DenseTaps::Mode::direct,    "direct");
+            runner.runDenseTaps (numTaps, DenseTaps::Mode::fft,       "fft");
+            runner.runDenseTaps (numTaps, DenseTaps::Mode::automatic, "automatic");
+        }
+
+        return 0;
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    ScopedJuceInitialiser_GUI juceInitialiser;
+
+    ArgumentList args (argc, argv);
+
+    return ConsoleApplication::invokeCatchingFailures ([&] { return runBenchmarks (args); });
+}
@@ -0,0 +1,533 @@
+/*
+  ==============================================================================
+
+    VariDelayRender.cpp
+
+    Headless offline renderer: streams an audio file through
+    VariDelayAudioProcessor::processBlock (no editor) and reports how much
+    faster than realtime the processing ran, with the percentiles of the
+    per-block load and how often each slow path was taken.
+
+    VariDelayRender --in dry.wav [--out wet.wav] [--block 512] [--rate 48000]
+                    [--tail 2.0] [--bits 24] [--set "Time L=350"] ...
+                    [--automation moves.csv] [--tap "250,0.5,-1"] ...
+                    [--dense-taps cloud.csv]
+
+    An automation file holds one "<seconds>, <parameter id>, <value>" line
+    per change; the changes are applied sample-accurately, whatever --block is.
+    A dense taps file holds one "<ms>, <gain>, <pan>" line per tap.
+
+    The file I/O streams in constant memory and runs on a background thread,
+    so the render loop only waits for the disk when the disk can't keep up.
+    WAV and AIFF input is read straight into the block being processed from
+    a memory-mapped window that moves along the file, with the pages ahead
+    of it touched in the background; other formats are decoded ahead by a
+    BufferingAudioReader. The output goes through an
+    AudioFormatWriter::ThreadedWriter.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../PluginProcessor.h"
+
+#include <iostream>
+
+namespace
+{
+    struct RenderSettings
+    {
+        File inputFile, outputFile;
+        int blockSize = 512;
+        double sampleRate = 0;      // 0 -> use the input file's rate
+        double tailSeconds = 2.0;   // keeps rendering after the input ends so the repeats ring out
+        int bitDepth = 24;
+        StringPairArray parameters; // parameter ID -> plain (unnormalised) value
+        File automationFile;
+        TapPattern taps;            // multi-tap mode, off unless --tap is given
+        File denseTapsFile;
+    };
+
+    struct AutomationPoint
+    {
+        double seconds;
+        String parameterID;
+        float value;
+    };
+
+    void printUsage()
+    {
+        std::cout << "usage: VariDelayRender --in <file> [--out <file.wav>] [--block <samples>]\n"
+                     "                       [--rate <Hz>] [--tail <seconds>] [--bits <16|24|32>]\n"
+                     "                       [--set \"<parameter id>=<value>\"] ...\n"
+                     "                       [--automation <file with \"<seconds>, <parameter id>, <value>\" lines>]\n"
+                     "                       [--tap \"<ms>,<gain>,<pan -1..1>\"] ...\n"
+                     "                       [--dense-taps <file with \"<ms>, <gain>, <pan>\" lines>]\n\n"
+                     "parameters: \"Time L\", \"Time R\" (ms), \"FB L\", \"FB R\" (dB), \"WET\" (0..1)\n";
+    }
+
+    bool parseSettings (const ArgumentList& args, RenderSettings& settings)
+    {
+        if (! args.containsOption ("--in"))
+            return false;
+
+        settings.inputFile = args.getExistingFileForOption ("--in");
+
+        if (args.containsOption ("--out"))
+            settings.outputFile = args.getFileForOption ("--out");
+
+        if (args.containsOption ("--block"))
+            settings.blockSize = args.getValueForOption ("--block").getIntValue();
+
+        if (args.containsOption ("--rate"))
+            settings.sampleRate = args.getValueForOption ("--rate").getDoubleValue();
+
+        if (args.containsOption ("--tail"))
+            settings.tailSeconds = args.getValueForOption ("--tail").getDoubleValue();
+
+        if (args.containsOption ("--bits"))
+            settings.bitDepth = args.getValueForOption ("--bits").getIntValue();
+
+        if (args.containsOption ("--automation"))
+            settings.automationFile = args.getExistingFileForOption ("--automation");
+
+        if (args.containsOption ("--dense-taps"))
+            settings.denseTapsFile = args.getExistingFileForOption ("--dense-taps");
+
+        /* --set may be repeated, so walk the raw argument list instead of using getValueForOption */
+        for (int i = 0; i < args.size() - 1; ++i)
+        {
+            if (args[i].text != "--set")
+                continue;
+
+            auto assignment = args[i + 1].text;
+
+            if (! assignment.containsChar ('='))
+                ConsoleApplication::fail ("--set expects \"<parameter id>=<value>\", got: " + assignment);
+
+            settings.parameters.set (assignment.upToFirstOccurrenceOf ("=", false, false).trim(),
+                                     assignment.fromFirstOccurrenceOf ("=", false, false).trim());
+        }
+
+        for (int i = 0; i < args.size() - 1; ++i)
+        {
+            if (args[i].text != "--tap")
+                continue;
+
+            auto fields = StringArray::fromTokens (args[i + 1].text, ",", {});
+
+            if (fields.size() != 3)
+                ConsoleApplication::fail ("--tap expects \"<ms>,<gain>,<pan>\", got: " + args[i + 1].text);
+
+            if (settings.taps.numTaps == TapPattern::maxNumTaps)
+                ConsoleApplication::fail ("at most " + String (TapPattern::maxNumTaps) + " taps");
+
+            settings.taps.taps[(size_t) settings.taps.numTaps++] = { fields[0].getFloatValue(),
+                                                                     fields[1].getFloatValue(),
+                                                                     fields[2].getFloatValue() };
+        }
+
+        if (settings.blockSize <= 0)
+            ConsoleApplication::fail ("--block must be a positive number of samples");
+
+        if (settings.sampleRate < 0 || settings.tailSeconds < 0)
+            ConsoleApplication::fail ("--rate and --tail must not be negative");
+
+        return true;
+    }
+
+    void applyParameters (VariDelayAudioProcessor& processor, const StringPairArray& parameters)
+    {
+        for (auto& id : parameters.getAllKeys())
+        {
+            auto* parameter = processor.apvts.getParameter (id);
+
+            if (parameter == nullptr)
+                ConsoleApplication::fail ("unknown parameter: " + id);
+
+            auto value = parameters[id].getFloatValue();
+            parameter->setValueNotifyingHost (parameter->convertTo0to1 (value));
+        }
+    }
+
+    std::vector<AutomationPoint> loadAutomation (const File& file)
+    {
+        std::vector<AutomationPoint> points;
+
+        if (file == File())
+            return points;
+
+        StringArray lines;
+        file.readLines (lines);
+
+        for (auto& line : lines)
+        {
+            if (line.trim().isEmpty() || line.trimStart().startsWithChar ('#'))
+                continue;
+
+            auto fields = StringArray::fromTokens (line, ",", "\"");
+            fields.trim();
+
+            if (fields.size() != 3)
+                ConsoleApplication::fail ("automation lines are \"<seconds>, <parameter id>, <value>\", got: " + line);
+
+            points.push_back ({ fields[0].getDoubleValue(), fields[1].unquoted(), fields[2].getFloatValue() });
+        }
+
+        std::stable_sort (points.begin(), points.end(),
+                          [] (const AutomationPoint& a, const AutomationPoint& b) { return a.seconds < b.seconds; });
+
+        return points;
+    }
+
+    std::vector<DelayTap> loadDenseTaps (const File& file)
+    {
+        std::vector<DelayTap> taps;
+
+        if (file == File())
+            return taps;
+
+        StringArray lines;
+        file.readLines (lines);
+
+        for (auto& line : lines)
+        {
+            if (line.trim().isEmpty() || line.trimStart().startsWithChar ('#'))
+                continue;
+
+            auto fields = StringArray::fromTokens (line, ",", {});
+            fields.trim();
+
+            if (fields.size() != 3)
+                ConsoleApplication::fail ("dense tap lines are \"<ms>, <gain>, <pan>\", got: " + line);
+
+            taps.push_back ({ fields[0].getFloatValue(), fields[1].getFloatValue(), fields[2].getFloatValue() });
+        }
+
+        if (taps.size() > (size_t) DenseTaps::maxNumTaps)
+            ConsoleApplication::fail ("at most " + String (DenseTaps::maxNumTaps) + " dense taps");
+
+        return taps;
+    }
+
+    //==============================================================================
+    /**
+        Maps a window of a memory-mapped file that moves along with the render
+        position, and keeps the pages in it resident a little ahead of that
+        position, so the render thread reads memory instead of faulting on
+        the disk. Pages that have been played are unmapped when the window
+        moves on, so however long the file, only the window stays mapped.
+
+        The render thread moves the window; the touching runs on the I/O
+        thread from construction until this is deleted, so it must go before
+        the reader does, including when a ConsoleApplication::fail unwinds
+        the render.
+    */
+    class MappedReadAhead  : public TimeSliceClient
+    {
+    public:
+        MappedReadAhead (MemoryMappedAudioFormatReader& mappedReader, int64 samplesAhead, TimeSliceThread& thread)
+            : reader (mappedReader),
+              ioThread (thread),
+              numSamplesAhead (samplesAhead),
+              samplesPerPage (jmax (1, 4096 / jmax (1, (int) (mappedReader.numChannels * mappedReader.bitsPerSample / 8))))
+        {
+            ioThread.addTimeSliceClient (this);
+        }
+
+        /* waits for a slice that's running to finish, so nothing touches the reader after this */
+        ~MappedReadAhead() override
+        {
+            ioThread.removeTimeSliceClient (this);
+        }
+
+        /**
+            Render thread: the file will be read from newPosition on. Once the
+            read-ahead would run off the end of the window, a new one twice
+            its length is mapped from there. Returns false if that fails.
+        */
+        bool setReadPosition (int64 newPosition)
+        {
+            const auto window = reader.getMappedSection();     // only this thread maps, so no lock to read it
+
+            if (window.getEnd() >= reader.lengthInSamples || newPosition + numSamplesAhead <= window.getEnd())
+            {
+                readPosition = newPosition;
+                return true;
+            }
+
+            const ScopedLock sl (mapLock);
+            readPosition = newPosition;
+            touchedUpTo = newPosition;
+
+            return reader.mapSectionOfFile ({ newPosition, jmin (reader.lengthInSamples, newPosition + 2 * numSamplesAhead) });
+        }
+
+        int useTimeSlice() override
+        {
+            const ScopedLock sl (mapLock);
+            const auto end = jmin (readPosition.load() + numSamplesAhead, reader.getMappedSection().getEnd());
+
+            if (touchedUpTo >= end)
+                return 5;
+
+            /* at most 256 pages a slice, so the writer gets its turns and a remap doesn't wait long */
+            const auto sliceEnd = jmin (end, touchedUpTo + 256 * (int64) samplesPerPage);
+
+            for (; touchedUpTo < sliceEnd; touchedUpTo += samplesPerPage)
+                reader.touchSample (touchedUpTo);
+
+            return 0;
+        }
+
+    private:
+        MemoryMappedAudioFormatReader& reader;
+        TimeSliceThread& ioThread;
+        const int64 numSamplesAhead;
+        const int samplesPerPage;
+        std::atomic<int64> readPosition { 0 };
+        CriticalSection mapLock;    // keeps the touching off the window while it's remapped
+        int64 touchedUpTo = 0;
+    };
+
+    struct InputStream
+    {
+        std::unique_ptr<AudioFormatReader> reader;
+        std::unique_ptr<MappedReadAhead> readAhead;     // only for a mapped reader; declared last so it's deleted first
+
+        bool isMapped() const noexcept
+        {
+            return readAhead != nullptr;
+        }
+    };
+
+    /* a few seconds of audio in flight each way, whatever the length of the file */
+    constexpr double readAheadSeconds   = 4.0;
+    constexpr double writeBufferSeconds = 4.0;
+
+    InputStream openInput (AudioFormatManager& formats, const File& file, TimeSliceThread& ioThread)
+    {
+        InputStream input;
+
+        if (auto* format = formats.findFormatForFileExtension (file.getFileExtension()))
+        {
+            std::unique_ptr<MemoryMappedAudioFormatReader> mapped (format->createMemoryMappedReader (file));
+
+            if (mapped != nullptr)
+            {
+                auto readAhead = std::make_unique<MappedReadAhead> (*mapped, (int64) (readAheadSeconds * mapped->sampleRate), ioThread);
+
+                /* maps the first window */
+                if (readAhead->setReadPosition (0))
+                {
+                    input.readAhead = std::move (readAhead);
+                    input.reader = std::move (mapped);
+                    return input;
+                }
+            }
+        }
+
+        if (auto* reader = formats.createReaderFor (file))
+        {
+            auto buffering = std::make_unique<BufferingAudioReader> (reader, ioThread, (int) (readAheadSeconds * reader->sampleRate));
+            buffering->setReadTimeout (-1);   // offline: wait for the decoder rather than render silence
+            input.reader = std::move (buffering);
+        }
+
+        return input;
+    }
+
+    std::unique_ptr<AudioFormatWriter> createWriter (const RenderSettings& settings, double sampleRate, int numChannels)
+    {
+        if (settings.outputFile == File())
+            return {};
+
+        settings.outputFile.deleteFile();
+        auto stream = settings.outputFile.createOutputStream();
+
+        if (stream == nullptr)
+            ConsoleApplication::fail ("cannot open output file: " + settings.outputFile.getFullPathName());
+
+        WavAudioFormat wav;
+        std::unique_ptr<AudioFormatWriter> writer (wav.createWriterFor (stream.get(), sampleRate, (unsigned int) numChannels,
+                                                                        settings.bitDepth, {}, 0));
+
+        if (writer == nullptr)
+            ConsoleApplication::fail ("cannot write a " + String (settings.bitDepth) + "-bit WAV file");
+
+        stream.release(); // now owned by the writer
+        return writer;
+    }
+
+    int render (const RenderSettings& settings)
+    {
+        AudioFormatManager formats;
+        formats.registerBasicFormats();
+
+        TimeSliceThread ioThread ("VariDelayRender I/O");
+        ioThread.startThread();
+
+        auto input = openInput (formats, settings.inputFile, ioThread);
+        auto* reader = input.reader.get();
+
+        if (reader == nullptr)
+            ConsoleApplication::fail ("cannot read input file: " + settings.inputFile.getFullPathName());
+
+        const auto sourceRate = reader->sampleRate;
+        const auto sampleRate = settings.sampleRate > 0 ? settings.sampleRate : sourceRate;
+        const auto blockSize  = settings.blockSize;
+
+        //==============================================================================
+        VariDelayAudioProcessor processor;
+        applyParameters (processor, settings.parameters);
+        processor.setTapPattern (settings.taps);
+        processor.setDenseTaps (loadDenseTaps (settings.denseTapsFile));
+
+        const auto automation = loadAutomation (settings.automationFile);
+        size_t nextPoint = 0;
+
+        processor.setNonRealtime (true);
+        processor.setRateAndBufferSizeDetails (sampleRate, blockSize);
+        processor.prepareToPlay (sampleRate, blockSize);
+
+        const auto numChannels = jmax (processor.getTotalNumInputChannels(), processor.getTotalNumOutputChannels());
+
+        //==============================================================================
+        /* at the file's own rate the reader fills the block directly; only resampling goes through sources */
+        AudioFormatReaderSource fileSource (reader, false);
+        ResamplingAudioSource resampler (&fileSource, false, numChannels);
+        const bool isResampling = sampleRate != sourceRate;
+
+        if (isResampling)
+        {
+            resampler.setResamplingRatio (sourceRate / sampleRate);
+            resampler.prepareToPlay (blockSize, sampleRate);
+        }
+
+        const auto inputLength = (int64) std::ceil ((double) reader->lengthInSamples * sampleRate / sourceRate);
+        const auto totalLength = inputLength + (int64) std::ceil (settings.tailSeconds * sampleRate);
+
+        std::unique_ptr<AudioFormatWriter::ThreadedWriter> writer;
+
+        if (auto fileWriter = createWriter (settings, sampleRate, processor.getTotalNumOutputChannels()))
+            writer = std::make_unique<AudioFormatWriter::ThreadedWriter> (fileWriter.release(), ioThread,
+                                                                          jmax (blockSize, (int) (writeBufferSeconds * sampleRate)));
+
+        //==============================================================================
+        AudioBuffer<float> buffer (numChannels, blockSize);
+        MidiBuffer midi;
+        int64 processTicks = 0;
+        int64 writeWaitTicks = 0;
+        int numWriteWaits = 0;
+
+        /* the ring holds 4096 blocks, so draining it once a block never loses any */
+        BlockLoadStatistics blockLoads;
+        auto timingCursor = processor.getBlockTimings().getNumPushed();
+
+        for (int64 position = 0; position < totalLength; position += blockSize)
+        {
+            const auto numSamples = (int) jmin ((int64) blockSize, totalLength - position);
+            buffer.setSize (numChannels, numSamples, false, false, true);
+
+            /* a mono file goes to both channels of a stereo block */
+            if (position >= inputLength)
+                buffer.clear();
+            else if (isResampling)
+                resampler.getNextAudioBlock (AudioSourceChannelInfo (buffer));
+            else
+                reader->read (&buffer, 0, numSamples, position, true, true);
+
+            /* a resampled file is read at its own rate, and a little ahead, so ask its source where it's got to */
+            if (input.isMapped() && ! input.readAhead->setReadPosition (isResampling ? fileSource.getNextReadPosition()
+                                                                                      : position + numSamples))
+                ConsoleApplication::fail ("cannot map input file: " + settings.inputFile.getFullPathName());
+
+            /* hand over the changes that fall in this block just before it is processed */
+            for (; nextPoint < automation.size(); ++nextPoint)
+            {
+                auto& point = automation[nextPoint];
+                const auto samplePosition = (int64) std::llround (point.seconds * sampleRate);
+
+                if (samplePosition >= position + numSamples)
+                    break;
+
+                if (! processor.scheduleParameterChange (point.parameterID, point.value, samplePosition))
+                    ConsoleApplication::fail ("cannot schedule automation for " + point.parameterID
+                                              + " (unknown parameter, or too many changes in one block)");
+            }
+
+            const auto start = Time::getHighResolutionTicks();
+            processor.processBlock (buffer, midi);
+            processTicks += Time::getHighResolutionTicks() - start;
+
+            processor.getBlockTimings().read (timingCursor, [&] (const BlockTiming& timing) { blockLoads.add (timing); });
+
+            /* the writer's FIFO is only full when the disk falls behind, so that's the one wait */
+            if (writer != nullptr && ! writer->write (buffer.getArrayOfReadPointers(), numSamples))
+            {
+                const auto waitStart = Time::getHighResolutionTicks();
+                ++numWriteWaits;
+
+                while (! writer->write (buffer.getArrayOfReadPointers(), numSamples))
+                    Thread::sleep (1);
+
+                writeWaitTicks += Time::getHighResolutionTicks() - waitStart;
+            }
+        }
+
+        if (isResampling)
+            resampler.releaseResources();
+
+        processor.releaseResources();
+        writer.reset();     // waits for the rest of the FIFO to reach the disk
+
+        const auto wasMapped = input.isMapped();
+        input.readAhead.reset();    // before the reader it touches; both unregister themselves from the thread
+        input.reader.reset();
+        ioThread.stopThread (1000);
+
+        //==============================================================================
+        const auto audioSeconds   = (double) totalLength / sampleRate;
+        const auto processSeconds = Time::highResolutionTicksToSeconds (processTicks);
+
+        std::cout << "rendered        " << audioSeconds << " s (" << totalLength << " samples, "
+                  << numChannels << " ch) at " << sampleRate << " Hz, block " << blockSize << "\n"
+                  << "input           " << (wasMapped ? "memory mapped" : "buffered decoder") << "\n"
+                  << "processBlock    " << processSeconds << " s\n"
+                  << "disk waits      " << numWriteWaits << " ("
+                  << Time::highResolutionTicksToSeconds (writeWaitTicks) << " s waiting for the writer)\n"
+                  << "realtime factor " << (processSeconds > 0 ? audioSeconds / processSeconds : 0.0) << "x\n"
+                  << "block load      mean " << 100.0f * blockLoads.getMeanLoad()
+                  << "%, p50 "   << 100.0f * blockLoads.getLoadPercentile (0.5)
+                  << "%, p99 "   << 100.0f * blockLoads.getLoadPercentile (0.99)
+                  << "%, p99.9 " << 100.0f * blockLoads.getLoadPercentile (0.999)
+                  << "%, max "   << 100.0f * blockLoads.getMaxLoad() << "% of the realtime budget\n";
+
+        for (int i = 0; i < BlockTiming::numSlowPaths; ++i)
+            std::cout << "                " << BlockTiming::getSlowPathName (i) << ": "
+                      << blockLoads.getSlowPathCount (i) << " of " << blockLoads.getNumBlocks() << " blocks\n";
+
+        return 0;
+    }
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    ScopedJuceInitialiser_GUI juceInitialiser; // the parameter tree and processor expect a message manager
+
+    ArgumentList args (argc, argv);
+
+    return ConsoleApplication::invokeCatchingFailures ([&]
+    {
+        RenderSettings settings;
+
+        if (args.containsOption ("--help|-h") || ! parseSettings (args, settings))
+        {
+            printUsage();
+            return args.containsOption ("--help|-h") ? 0 : 1;
+        }
+
+        return render (settings);
+    });
+}
@@ -0,0 +1,75 @@
+/*
+  ==============================================================================
+
+    TripleBuffer.h
+
+  ==============================================================================
+*/
+
+#pragma once
+
+//==============================================================================
+/**
+    Hands a trivially copyable value from one writer thread to one reader
+    thread without locks and without either side ever waiting.
+
+    The writer fills a back buffer and swaps it with the shared middle one;
+    the reader swaps the middle buffer with its front one only when the
+    writer flagged it as new. The reader therefore always sees a complete
+    value, never a mix of two writes.
+
+    Several writer threads must be serialised by the caller.
+*/
+template <typename Type>
+class TripleBuffer
+{
+public:
+    static_assert (std::is_trivially_copyable<Type>::value, "TripleBuffer copies values with plain assignment");
+
+    TripleBuffer() = default;
+
+    explicit TripleBuffer (const Type& initialValue)
+    {
+        buffers.fill (initialValue);
+    }
+
+    //==============================================================================
+    /** Writer side: publishes a new value */
+    void write (const Type& value) noexcept
+    {
+        buffers[(size_t) backIndex] = value;
+
+        auto previous = middle.exchange (backIndex | newDataFlag, std::memory_order_acq_rel);
+        backIndex = previous & indexMask;
+    }
+
+    //==============================================================================
+    /** Reader side: true if a value was published since the last read() */
+    bool isNewDataAvailable() const noexcept
+    {
+        return (middle.load (std::memory_order_relaxed) & newDataFlag) != 0;
+    }
+
+    /** Reader side: returns the most recently published value */
+    const Type& read() noexcept
+    {
+        if ((middle.load (std::memory_order_relaxed) & newDataFlag) != 0)
+        {
+            auto previous = middle.exchange (frontIndex, std::memory_order_acq_rel);
+            frontIndex = previous & indexMask;
+        }
+
+        return buffers[(size_t) frontIndex];
+    }
+
+private:
+    static constexpr int indexMask   = 3;
+    static constexpr int newDataFlag = 4;
+
+    std::array<Type, 3> buffers {};
+    std::atomic<int> middle { 1 };
+    int backIndex  = 0;   // only touched by the writer
+    int frontIndex = 2;   // only touched by the reader
+
+    JUCE_DECLARE_NON_COPYABLE (TripleBuffer)
+};